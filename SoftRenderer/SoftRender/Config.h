@@ -1,3 +1,4 @@
 #pragma once
 
-typedef unsigned int uint32;
\ No newline at end of file
+typedef unsigned int uint32;
+typedef unsigned short uint16;
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "DemoScene.h"
+#include "Device.h"
+#include "Transform.h"
+#include "Vertex.h"
+#include "Light.h"
+#include "Mesh.h"
+#include "Texture.h"
+#include "Shader.h"
+#include <stdlib.h>
+
+void TransformLight( Transform* transform, Light& light, float theta )
+{
+	Matrix m;
+	MatrixSetRotate( m, 0.f, 0.0f, 1.f, theta );
+	transform->setWorld( m );
+	transform->update( );
+
+	transform->applyWV( light.direction, { - 0.3f, 1.f, - 0.3f, 0.f } );
+	VectorNormalize( light.direction );
+}
+
+void DrawDemoScene( Device* device )
+{
+	Vertex v1 = { { 300.f, 400.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawPoint2d( v1 );
+	Vertex v2 = { { 301.f, 400.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawPoint2d( v2 );
+	Vertex v3 = { { 299.f, 400.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawPoint2d( v3 );
+	Vertex v4 = { { 300.f, 401.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawPoint2d( v4 );
+	Vertex v5 = { { 300.f, 399.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawPoint2d( v5 );
+
+	Vertex v6 = { { 0.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v7 = { { 0.f, -1.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawLine3d( v6, v7 );
+
+	Vertex v8 = { { 0.f, -1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v9 = { { 0.f, 1.f, -1.f, 1.f }, { 1.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawLine3d( v8, v9 );
+
+	Vertex v10 = { { 0.f, 1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v11 = { { 0.f, -1.f, 0.f, 1.f }, { 1.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawLine3d( v10, v11 );
+
+	Vertex v12 = { { 0.f, 0.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v13 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawLine3d( v12, v13 );
+
+	Vertex v14 = { { 0.f, -1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v15 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v16 = { { 0.f, 1.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawTriangle3d( v14, v15, v16 );
+
+	Vertex v17 = { { 0.f, -1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v18 = { { 0.f, 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v19 = { { 0.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawTriangle3d( v17, v18, v19 );
+
+	Vertex v20 = { { 0.f, -1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v21 = { { 0.f, -1.f, -2.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v22 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawTriangle3d( v20, v21, v22 );
+
+	Vertex v23 = { { 0.f, 1.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v24 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v25 = { { 0.f, 1.f, -2.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawTriangle3d( v23, v24, v25 );
+
+	Vertex v26 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v27 = { { 0.f, -1.f, -2.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	Vertex v28 = { { 0.f, 1.f, -2.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
+	device->drawTriangle3d( v26, v27, v28 );
+}
+
+void FitMeshToView( Matrix& world, const Vertex* vertices, int vertexCount )
+{
+	Vector min, max;
+	ComputeMeshBounds( min, max, vertices, vertexCount );
+
+	Vector center = ( min + max ) * 0.5f;
+	float radius = VectorLength( max - min ) * 0.5f;
+	float scale = radius > 0.f ? 2.f / radius : 1.f;
+
+	Matrix t, s, r, m;
+	MatrixSetTranslate( t, - center.x, - center.y, - center.z );
+	MatrixSetScale( s, scale, scale, scale );
+	MatrixSetZero( r );
+	r.m[0][0] = 1.f;
+	r.m[1][2] = 1.f;
+	r.m[2][1] = - 1.f;
+	r.m[3][3] = 1.f;
+	MatrixMul( m, t, s );
+	MatrixMul( world, m, r );
+}
+
+void DrawDemoFloor( Device* device, Transform* transform )
+{
+	Matrix m;
+	MatrixSetIdentity( m );
+	transform->setWorld( m );
+	transform->update( );
+
+	// texture repeats every 4 units, so the far end is heavily minified
+	Vertex v1 = { { 4.f, -30.f, -1.5f, 1.f }, { 1.f, 1.f, 1.f }, { 1.f, -7.5f }, { 0.f, 0.f, 1.f, 0.f } };
+	Vertex v2 = { { 4.f, 30.f, -1.5f, 1.f }, { 1.f, 1.f, 1.f }, { 1.f, 7.5f }, { 0.f, 0.f, 1.f, 0.f } };
+	Vertex v3 = { { -60.f, 30.f, -1.5f, 1.f }, { 1.f, 1.f, 1.f }, { -15.f, 7.5f }, { 0.f, 0.f, 1.f, 0.f } };
+	Vertex v4 = { { -60.f, -30.f, -1.5f, 1.f }, { 1.f, 1.f, 1.f }, { -15.f, -7.5f }, { 0.f, 0.f, 1.f, 0.f } };
+	device->drawTriangle3d( v1, v2, v3 );
+	device->drawTriangle3d( v1, v3, v4 );
+}
+
+int CreateCheckerTexture( Texture& texture, int size, int cells )
+{
+	uint32* pixels = ( uint32* )malloc( size * size * sizeof( uint32 ) );
+	if ( pixels == NULL ) return -2;
+
+	int cell = std::max( size / cells, 1 );
+	for ( int y = 0; y < size; y ++ )
+	{
+		for ( int x = 0; x < size; x ++ )
+		{
+			pixels[y * size + x] = ( ( x / cell ) + ( y / cell ) ) & 1 ? 0xffffff : 0x3060c0;
+		}
+	}
+
+	int ret = texture.init( pixels, size, size );
+	free( pixels );
+	return ret;
+}
+
+// example material for Device::drawShaded: vertex color lit in three hard bands
+struct ToonShader
+{
+	struct Varyings
+	{
+		float	r, g, b;
+		float	nx, ny, nz;
+	};
+	typedef Vertex Input;
+
+	Transform*		transform;
+	const Light*	light;
+
+	void vertex( Vector& clip, Varyings& out, const Vertex& in ) const
+	{
+		transform->applyWVP( clip, in.pos );
+		out = { in.color.r, in.color.g, in.color.b, in.normal.x, in.normal.y, in.normal.z };
+	}
+
+	Color pixel( const Varyings& in ) const
+	{
+		Vector n = { in.nx, in.ny, in.nz, 0.f };
+		VectorNormalize( n );
+		float ndotl = - ( light->direction.x * n.x + light->direction.y * n.y + light->direction.z * n.z );
+		float band = ndotl > 0.8f ? 1.f : ndotl > 0.4f ? 0.6f : ndotl > 0.1f ? 0.35f : 0.15f;
+		return { in.r * light->color.r * band, in.g * light->color.g * band, in.b * light->color.b * band };
+	}
+};
+
+void DrawToonMesh( Device* device, Transform* transform, const Light* light, const Vertex* vertices, int vertexCount,
+	const uint32* indices, int indexCount )
+{
+	ToonShader shader = { transform, light };
+	device->drawShaded( shader, vertices, vertexCount, indices, indexCount );
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Config.h"
+#include "math.h"
+
+class Device;
+class Transform;
+class Texture;
+struct Light;
+struct Vertex;
+
+// the hard-coded test scene shared by the win32 viewer and the batch driver
+void	TransformLight( Transform* transform, Light& light, float theta );
+void	DrawDemoScene( Device* device );
+// large textured floor receding to the horizon under the scene, drawn with an identity world matrix
+void	DrawDemoFloor( Device* device, Transform* transform );
+// size x size texture of cells x cells alternating squares, size has to be a power of two
+int		CreateCheckerTexture( Texture& texture, int size, int cells );
+// world matrix that centers the given vertices, scales them to a radius of 2 and turns the y-up obj models z-up
+void	FitMeshToView( Matrix& world, const Vertex* vertices, int vertexCount );
+// draws the mesh with the example toon material through Device::drawShaded instead of an illumination mode
+void	DrawToonMesh( Device* device, Transform* transform, const Light* light, const Vertex* vertices, int vertexCount,
+			const uint32* indices, int indexCount );
\ No newline at end of file
@@ -2,30 +2,262 @@
 #include "Vertex.h"
 #include "Transform.h"
 #include "Light.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "ShadowMap.h"
+#include "VertexFormat.h"
 #include <math.h>
 
+// std::min and friends take these by reference, so they need a definition
+const int Device::MAX_VARYINGS;
+const int Device::MAX_PIPELINE_DEPTH;
+
+// edge length of the pixel blocks that are trivially rejected or accepted as a whole
+static const int RASTER_BLOCK = 8;
+
+// edge length of the screen tiles triangles are binned into, each tile is rasterized by one worker
+static const int RASTER_TILE = 64;
+
+// vertices are snapped to 1 / 256 pixel before rasterization, the guard band keeps the 16.8 values in 24 bits
+static const int SUBPIXEL_BITS = 8;
+static const float SUBPIXEL_SCALE = ( float )( 1 << SUBPIXEL_BITS );
+
+// multisample positions in 1 / 16 pixel around the pixel sample point, the standard 4x and 8x patterns
+static const int SAMPLE_POSITIONS_4X[4][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+static const int SAMPLE_POSITIONS_8X[8][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+
+// every multisample position lies within half a pixel of the pixel sample point
+static const int SAMPLE_MARGIN = 1 << ( SUBPIXEL_BITS - 1 );
+
+// sampleSlot bits: the colors of the pixel live in the sample store, and its sample depths were written since
+// the tile was cleared ( they are clearDepth otherwise, so a clear never touches sampleDepth ). the low bits
+// keep the store slot the pixel was given, so going back and forth between one and several colors reuses it
+static const unsigned short SAMPLE_EXPANDED = 0x8000;
+static const unsigned short SAMPLE_WRITTEN = 0x4000;
+static const unsigned short SAMPLE_INDEX = 0x3fff;
+
+// number of lanes set in a shadeQuad mask
+static inline int MaskCount( int mask )
+{
+	int n = 0;
+	for ( ; mask != 0; mask &= mask - 1 ) n ++;
+	return n;
+}
+
+// value of edge k at the sample point of pixel ( x, y )
+static inline long long EdgeAt( const TriangleSetup& ts, int k, int x, int y )
+{
+	return ( long long )ts.ea[k] * ( x << SUBPIXEL_BITS ) + ( long long )ts.eb[k] * ( y << SUBPIXEL_BITS ) + ts.ec[k];
+}
+
+// reject when a size x size pixel square lies outside an edge, accept when it lies inside all of them;
+// margin grows the square by that many subpixels on every side to take in the multisample positions
+static inline bool EdgeTestRect( const TriangleSetup& ts, int x, int y, int size, bool& inside, int margin = 0 )
+{
+	inside = true;
+	for ( int k = 0; k < 3; k ++ )
+	{
+		long long e = EdgeAt( ts, k, x, y ) - ( long long )ts.ea[k] * margin - ( long long )ts.eb[k] * margin;
+		long long dx = ( long long )ts.ea[k] * ( ( ( size - 1 ) << SUBPIXEL_BITS ) + 2 * margin );
+		long long dy = ( long long )ts.eb[k] * ( ( ( size - 1 ) << SUBPIXEL_BITS ) + 2 * margin );
+		if ( e + std::max( dx, 0ll ) + std::max( dy, 0ll ) < 0 ) return false;
+		if ( e + std::min( dx, 0ll ) + std::min( dy, 0ll ) < 0 ) inside = false;
+	}
+	return true;
+}
+
+// color an untouched tile holds after clear( ), its depth is the far plane key clearDepth
+static const uint32 CLEAR_COLOR = 0x000000;
+
+// bytes per pixel of the depth buffer
+static inline size_t DepthSize( DepthFormat format )
+{
+	return format == DepthFormat::UNORM16 ? sizeof( uint16 ) : sizeof( float );
+}
+
+static inline bool IsUnorm( DepthFormat format )
+{
+	return format == DepthFormat::UNORM24 || format == DepthFormat::UNORM16;
+}
+
+// the lanes in mask of a depth buffer row as keys, the others read as 0 without touching memory past the row
+template<class T>
+static inline void LoadDepthRow( float* keys, const T* row, int mask )
+{
+	for ( int l = 0; l < SIMD_WIDTH; l ++ ) keys[l] = ( mask >> l ) & 1 ? ( float )row[l] : 0.f;
+}
+
+template<class T>
+static inline void StoreDepthRow( T* row, const float* keys, int mask )
+{
+	for ( int l = 0; l < SIMD_WIDTH; l ++ )
+	{
+		if ( ( mask >> l ) & 1 ) row[l] = ( T )keys[l];
+	}
+}
+
+// key range of the depth buffer rectangle from ( x0, y0 ) up to but excluding ( x1, y1 )
+template<class T>
+static inline void DepthRange( const T* depth, int width, int x0, int y0, int x1, int y1, float& zmin, float& zmax )
+{
+	for ( int y = y0; y < y1; y ++ )
+	{
+		const T* row = depth + y * width;
+		for ( int x = x0; x < x1; x ++ )
+		{
+			zmin = std::min( zmin, ( float )row[x] );
+			zmax = std::max( zmax, ( float )row[x] );
+		}
+	}
+}
+
+// edge length of the squares the deferred lighting pass culls point lights for
+static const int LIGHT_TILE = 16;
+
+// g-buffer normal: x, y, z mapped from [-1, 1] to 10 bits each, the top two bits mark a pixel to be lit
+static const uint32 GBUFFER_WRITTEN = 3u << 30;
+
+static inline uint32 PackNormal( float x, float y, float z )
+{
+	uint32 ix = ( uint32 )( std::min( std::max( x * 0.5f + 0.5f, 0.f ), 1.f ) * 1023.f + 0.5f );
+	uint32 iy = ( uint32 )( std::min( std::max( y * 0.5f + 0.5f, 0.f ), 1.f ) * 1023.f + 0.5f );
+	uint32 iz = ( uint32 )( std::min( std::max( z * 0.5f + 0.5f, 0.f ), 1.f ) * 1023.f + 0.5f );
+	return GBUFFER_WRITTEN | ( ix << 20 ) | ( iy << 10 ) | iz;
+}
+
+static inline void UnpackNormal( uint32 n, float& x, float& y, float& z )
+{
+	x = ( ( n >> 20 ) & 1023 ) * ( 2.f / 1023.f ) - 1.f;
+	y = ( ( n >> 10 ) & 1023 ) * ( 2.f / 1023.f ) - 1.f;
+	z = ( n & 1023 ) * ( 2.f / 1023.f ) - 1.f;
+}
+
+// material constants shared by the scalar *PS functions and the SIMD shading path
+static const float DIFFUSE_KD = 0.5f;
+static const float PHONG_KD = 1.0f;
+static const float PHONG_KS = 1.5f;
+static const int PHONG_SHINE = 20;
+
+// triangles may extend GUARD_BAND times the viewport half size around the screen center before they have to be
+// clipped on the side planes, everything between the viewport and the guard band is left to the bbox clamp
+static const float GUARD_BAND = 8.f;
+
+// clip space planes, a point is inside plane k when ClipDistance( p, k, reversed ) >= 0; reversed depth puts
+// the near plane at z = w and the far plane at z = 0
+enum
+{
+	CLIP_NEAR, CLIP_FAR, CLIP_LEFT, CLIP_RIGHT, CLIP_BOTTOM, CLIP_TOP,
+	CLIP_GUARD_LEFT, CLIP_GUARD_RIGHT, CLIP_GUARD_BOTTOM, CLIP_GUARD_TOP, CLIP_PLANES
+};
+
+// planes a triangle is actually split on, the view volume side planes and the far plane are handled by
+// the screen clamp and the depth test instead
+static const int CLIP_TRIANGLE_MASK = ( 1 << CLIP_NEAR ) | ( 1 << CLIP_GUARD_LEFT ) | ( 1 << CLIP_GUARD_RIGHT ) |
+	( 1 << CLIP_GUARD_BOTTOM ) | ( 1 << CLIP_GUARD_TOP );
+
+static inline float ClipDistance( const Vector& p, int plane, bool reversed )
+{
+	switch ( plane )
+	{
+	case CLIP_NEAR:			return reversed ? p.w - p.z : p.z;
+	case CLIP_FAR:			return reversed ? p.z : p.w - p.z;
+	case CLIP_LEFT:			return p.w + p.x;
+	case CLIP_RIGHT:		return p.w - p.x;
+	case CLIP_BOTTOM:		return p.w + p.y;
+	case CLIP_TOP:			return p.w - p.y;
+	case CLIP_GUARD_LEFT:	return GUARD_BAND * p.w + p.x;
+	case CLIP_GUARD_RIGHT:	return GUARD_BAND * p.w - p.x;
+	case CLIP_GUARD_BOTTOM:	return GUARD_BAND * p.w + p.y;
+	default:				return GUARD_BAND * p.w - p.y;
+	}
+}
+
+static inline int ClipCode( const Vector& p, bool reversed )
+{
+	int code = 0;
+	for ( int k = 0; k < CLIP_PLANES; k ++ )
+	{
+		if ( ClipDistance( p, k, reversed ) < 0.f ) code |= 1 << k;
+	}
+	return code;
+}
+
+static inline Vector InterpVector( const Vector& x, const Vector& y, float t )
+{
+	return { interp( x.x, y.x, t ), interp( x.y, y.y, t ), interp( x.z, y.z, t ), interp( x.w, y.w, t ) };
+}
+
+// every vertex attribute is affine in clip space, so a point on a clipped edge interpolates them linearly
+static inline Vertex InterpVertex( const Vertex& x, const Vertex& y, float t )
+{
+	Vertex v;
+	v.pos = InterpVector( x.pos, y.pos, t );
+	v.color = { interp( x.color.r, y.color.r, t ), interp( x.color.g, y.color.g, t ), interp( x.color.b, y.color.b, t ) };
+	v.tex = { interp( x.tex.u, y.tex.u, t ), interp( x.tex.v, y.tex.v, t ) };
+	v.normal = InterpVector( x.normal, y.normal, t );
+	return v;
+}
+
 void Device::init( int w, int h, uint32* fb, Transform* ts, int** tex, Light* l, IlluminationMode il )
 {
 	width = w;
 	height = h;
 	illuminationMode = il;
 
+	outputBuffer = fb;
 	framebuffer = ( uint32** )malloc( h * sizeof( uint32* ) );
 	for ( int y = 0; y < h; y ++ )
 	{
 		framebuffer[y] = fb + y * w;
 	}
 
-	zbuffer = ( float* )malloc( w * h * sizeof( float ) );
-	memset( zbuffer, 0, w * h * sizeof( float ) );
+	zbuffer = malloc( w * h * DepthSize( depthFormat ) );
+	memset( zbuffer, 0, w * h * DepthSize( depthFormat ) );
+
+	gbufferNormal = ( uint32* )malloc( w * h * sizeof( uint32 ) );
+	memset( gbufferNormal, 0, w * h * sizeof( uint32 ) );
+
+	blocksX = ( w + RASTER_BLOCK - 1 ) / RASTER_BLOCK;
+	blocksY = ( h + RASTER_BLOCK - 1 ) / RASTER_BLOCK;
+	hizBlockMin = ( float* )malloc( blocksX * blocksY * sizeof( float ) );
+	hizBlockMax = ( float* )malloc( blocksX * blocksY * sizeof( float ) );
+	memset( hizBlockMin, 0, blocksX * blocksY * sizeof( float ) );
+	memset( hizBlockMax, 0, blocksX * blocksY * sizeof( float ) );
 
 	transform = ts;
 	textures = tex;
 	light = l;
+
+	tilesX = ( w + RASTER_TILE - 1 ) / RASTER_TILE;
+	tilesY = ( h + RASTER_TILE - 1 ) / RASTER_TILE;
+	record = newBatch( );
+	record->target = fb;
+
+	hizTileMax = ( float* )malloc( tilesX * tilesY * sizeof( float ) );
+	memset( hizTileMax, 0, tilesX * tilesY * sizeof( float ) );
+
+	tileCleared = ( unsigned char* )malloc( tilesX * tilesY );
+	memset( tileCleared, 0, tilesX * tilesY );
+
+	setThreadCount( 0 );
+}
+
+void Device::setThreadCount( int count )
+{
+	if ( count <= 0 )
+	{
+		count = ( int )std::thread::hardware_concurrency( );
+		if ( count <= 0 ) count = 1;
+	}
+
+	sync( );
+	if ( threadPool == NULL ) threadPool = new ThreadPool( );
+	threadPool->init( count );
 }
 
 void Device::SetCamera( float x, float y, float z )
 {
+	flush( );
 	camEye = { x, y, z, 1.f };
 	Vector at = { 0.f, 0.f, 0.f, 1.f }, up = { 0.f, 0.f, 1.f, 1.f };
 	Matrix m;
@@ -34,384 +266,2170 @@ void Device::SetCamera( float x, float y, float z )
 	transform->update( );
 }
 
-void Device::clear( )
+void Device::setPipelineDepth( int depth )
 {
-	for ( int y = 0; y < height; y ++ )
+	depth = std::min( std::max( depth, 1 ), MAX_PIPELINE_DEPTH );
+
+	flush( );
+	finish( );
+	if ( depth == pipelineDepth ) return;
+
+	if ( rasterQueue != NULL )
 	{
-		for ( int x = 0; x < width; x ++ )
-		{
-			framebuffer[y][x] = 0x000000;
-			zbuffer[y * width + x] = 1.f;
-		}
+		delete rasterQueue;
+		rasterQueue = NULL;
+		for ( size_t i = 0; i < queuedBatches.size( ); i ++ ) freeBatches.push_back( queuedBatches[i].second );
+		queuedBatches.clear( );
 	}
-}
-
-void Device::close( )
-{
-	if ( framebuffer != NULL )
+	if ( colorBuffers != NULL )
 	{
-		free( framebuffer );
+		free( colorBuffers );
+		colorBuffers = NULL;
 	}
 
-	if ( zbuffer != NULL )
+	pipelineDepth = depth;
+	frameIndex = 0;
+	framesShown = 0;
+	record->target = outputBuffer;
+	if ( depth > 1 )
 	{
-		free( zbuffer );
+		colorBuffers = ( uint32* )malloc( ( size_t )depth * width * height * sizeof( uint32 ) );
+		rasterQueue = new JobQueue( );
+		rasterQueue->init( );
+		record->target = colorBuffers;
 	}
+	setTarget( record->target );
 }
 
-void Device::drawPoint2d( const Vertex& sv )
+void Device::setSampleCount( int count )
 {
-	int y = ( int )sv.pos.y;
-	int x = ( int )sv.pos.x;
+	count = count >= 8 ? 8 : ( count >= 4 ? 4 : 1 );
 
-	if ( y < 0 || y >= height ) return;
-	if ( x < 0 || x >= width ) return;
+	sync( );
+	if ( count == sampleCount ) return;
 
-	if ( zbuffer[y * width + x] < sv.pos.z )
-		return;
+	if ( sampleDepth != NULL )
+	{
+		free( sampleDepth );
+		free( sampleSlot );
+		sampleDepth = NULL;
+		sampleSlot = NULL;
+	}
+	sampleColors.clear( );
 
-	int r = sv.color.r > 1 ? 255 : ( int )( sv.color.r * 255 );
-	int g = sv.color.g > 1 ? 255 : ( int )( sv.color.g * 255 );
-	int b = sv.color.b > 1 ? 255 : ( int )( sv.color.b * 255 );
+	sampleCount = count;
+	if ( count == 1 ) return;
 
-	int hexColor = ( r << 16 ) | ( g << 8 ) | b;
+	size_t pixels = ( size_t )width * height;
+	sampleDepth = ( float* )malloc( pixels * count * sizeof( float ) );
+	sampleSlot = ( unsigned short* )malloc( pixels * sizeof( unsigned short ) );
+	memset( sampleSlot, 0, pixels * sizeof( unsigned short ) );
+	sampleColors.assign( tilesX * tilesY, std::vector<uint32>( ) );
+}
 
-	framebuffer[y][x] = hexColor;
-	zbuffer[y * width + x] = sv.pos.z;
+void Device::setDepthFormat( DepthFormat format )
+{
+	sync( );
+	if ( format == depthFormat ) return;
+
+	depthFormat = format;
+	switch ( format )
+	{
+	case DepthFormat::FLOAT32_REVERSED:	depthScale = -1.f; break;
+	case DepthFormat::UNORM24:			depthScale = ( float )( ( 1 << 24 ) - 1 ); break;
+	case DepthFormat::UNORM16:			depthScale = ( float )( ( 1 << 16 ) - 1 ); break;
+	default:							depthScale = 1.f; break;
+	}
+	// the far plane lies at projected depth 0 when reversed and at 1 otherwise
+	clearDepth = getDepthKey( format == DepthFormat::FLOAT32_REVERSED ? 0.f : 1.f );
+
+	free( zbuffer );
+	zbuffer = malloc( ( size_t )width * height * DepthSize( format ) );
+	memset( zbuffer, 0, ( size_t )width * height * DepthSize( format ) );
 }
 
-void Device::drawLine3d( const Vertex& wv1, const Vertex& wv2 )
+inline void Device::setDepth( int p, float key )
 {
-	if( wv1.pos.w != 1.0f ) return;
-	if( wv2.pos.w != 1.0f ) return;
+	if ( depthFormat == DepthFormat::UNORM16 ) ( ( uint16* )zbuffer )[p] = ( uint16 )key;
+	else if ( depthFormat == DepthFormat::UNORM24 ) ( ( int* )zbuffer )[p] = ( int )key;
+	else ( ( float* )zbuffer )[p] = key;
+}
 
-	Vertex pv1 = wv1;
-	Vertex pv2 = wv2;
+void Device::fillDepth( int p, int count, float key )
+{
+	if ( depthFormat == DepthFormat::UNORM16 ) std::fill( ( uint16* )zbuffer + p, ( uint16* )zbuffer + p + count, ( uint16 )key );
+	else if ( depthFormat == DepthFormat::UNORM24 ) std::fill( ( int* )zbuffer + p, ( int* )zbuffer + p + count, ( int )key );
+	else std::fill( ( float* )zbuffer + p, ( float* )zbuffer + p + count, key );
+}
 
-	transform->applyWVP( pv1.pos, wv1.pos );
-	transform->applyWVP( pv2.pos, wv2.pos );
+inline void Device::loadDepth( float* keys, int p, int mask ) const
+{
+	if ( depthFormat == DepthFormat::UNORM16 ) LoadDepthRow( keys, ( const uint16* )zbuffer + p, mask );
+	else if ( depthFormat == DepthFormat::UNORM24 ) LoadDepthRow( keys, ( const int* )zbuffer + p, mask );
+	else LoadDepthRow( keys, ( const float* )zbuffer + p, mask );
+}
 
-	if ( checkCvv( pv1 ) ) return;
-	if ( checkCvv( pv2 ) ) return;
+inline void Device::storeDepth( int p, const float* keys, int mask )
+{
+	if ( depthFormat == DepthFormat::UNORM16 ) StoreDepthRow( ( uint16* )zbuffer + p, keys, mask );
+	else if ( depthFormat == DepthFormat::UNORM24 ) StoreDepthRow( ( int* )zbuffer + p, keys, mask );
+	else StoreDepthRow( ( float* )zbuffer + p, keys, mask );
+}
 
-	Vertex sv1 = pv1;
-	Vertex sv2 = pv2;
-	transform->homogenizeVert( sv1.pos, pv1.pos );
-	transform->homogenizeVert( sv2.pos, pv2.pos );
+// the unorm formats round to the nearest integer, like the buffer holds it, and clamp at the near plane
+inline float Device::roundDepth( float key ) const
+{
+	return IsUnorm( depthFormat ) ? std::max( nearbyintf( key ), 0.f ) : key;
+}
 
-	Vector v1 = { ( float )floor( sv1.pos.x ), ( float )floor( sv1.pos.y ), ( float )floor( sv1.pos.z ) };
-	Vector v2 = { ( float )floor( sv2.pos.x ), ( float )floor( sv2.pos.y ), ( float )floor( sv2.pos.z ) };
+inline vfloat Device::roundDepth( vfloat key ) const
+{
+	return IsUnorm( depthFormat ) ? vmax( vround( key ), vset1( 0.f ) ) : key;
+}
 
-	if ( v1 == v2 )
+void Device::clear( )
+{
+	// triangles still waiting in the bins would be cleared anyway
+	record->triangles.clear( );
+	for ( size_t i = 0; i < record->bins.size( ); i ++ )
 	{
-		drawPoint2d( sv1 );
+		record->bins[i].clear( );
 	}
-	else if( v1.x == v2.x )
+	record->clear = true;
+	deferredFrame = false;
+}
+
+void Device::present( )
+{
+	record->present = true;
+	flush( );
+	unpackedMesh = NULL;
+
+	if ( rasterQueue != NULL )
 	{
-		int step = v2.y > v1.y ? 1 : -1;
-		for ( int i = ( int )v1.y; i != ( int )v2.y; i += step )
-		{
-			float sf = ( i - v1.y ) / ( v2.y - v1.y );
-			float inv = 1 / ( sf / pv1.pos.w + ( 1 - sf ) / pv2.pos.w );
-			float wf = ( sf / pv1.pos.w ) * inv;
-
-			Color co = {
-				sv1.color.r * ( 1 - wf ) + sv2.color.r * wf,
-				sv1.color.g * ( 1 - wf ) + sv2.color.g * wf,
-				sv1.color.b * ( 1 - wf ) + sv2.color.b * wf
-			};
+		frameTickets[frameIndex % pipelineDepth] = queuedBatches.back( ).first;
+		frameIndex ++;
+
+		// the buffer of the frame depth - 1 behind this one is the next to be rendered into, so that frame is
+		// shown now, waiting for the raster thread if it is still behind
+		int shown = frameIndex - pipelineDepth;
+		if ( shown >= framesShown ) showFrame( shown );
+		record->target = colorBuffers + ( size_t )( frameIndex % pipelineDepth ) * width * height;
+
+#ifdef SOFTRENDER_PROFILE
+		// the profiler folds the per thread counters while nothing else writes them
+		rasterQueue->wait( );
+#endif
+	}
 
-			Texcoord te = {
-				sv1.tex.u * ( 1 - wf ) + sv2.tex.u * wf,
-				sv1.tex.v * ( 1 - wf ) + sv2.tex.v * wf
-			};
+	PROFILE_END_FRAME( );
+}
 
-			Vector nor = {
-				sv1.normal.x * ( 1 - wf ) + sv2.normal.x * wf,
-				sv1.normal.y * ( 1 - wf ) + sv2.normal.y * wf,
-				sv1.normal.z * ( 1 - wf ) + sv2.normal.z * wf,
-				0.f
-			};
+void Device::finish( )
+{
+	if ( rasterQueue == NULL ) return;
 
-			Vertex p = { { v1.x, ( float )i, v1.z * ( 1 - wf ) + v2.z * wf, 1.f }, co, te, nor } ;
-			drawPoint2d( p );
-		}
-	}
-	else if ( v1.y == v2.y )
-	{
-		int step = v2.x > v1.x ? 1 : -1;
-		for ( int i = ( int )v1.x; i != ( int )v2.x; i += step )
-		{
-			float sf = ( i - v1.x ) / ( v2.x - v1.x );
-			float inv = 1 / ( sf / pv1.pos.w + ( 1 - sf ) / pv2.pos.w );
-			float wf = ( sf / pv1.pos.w ) * inv;
-
-			Color co = {
-				sv1.color.r * ( 1 - wf ) + sv2.color.r * wf,
-				sv1.color.g * ( 1 - wf ) + sv2.color.g * wf,
-				sv1.color.b * ( 1 - wf ) + sv2.color.b * wf
-			};
+	flush( );
+	rasterQueue->wait( );
+	if ( frameIndex > framesShown ) showFrame( frameIndex - 1 );
+}
 
-			Texcoord te = {
-				sv1.tex.u * ( 1 - wf ) + sv2.tex.u * wf,
-				sv1.tex.v * ( 1 - wf ) + sv2.tex.v * wf
-			};
+void Device::showFrame( int frame )
+{
+	rasterQueue->wait( frameTickets[frame % pipelineDepth] );
+	memcpy( outputBuffer, colorBuffers + ( size_t )( frame % pipelineDepth ) * width * height, ( size_t )width * height * sizeof( uint32 ) );
+	framesShown = frame + 1;
+}
 
-			Vector nor = {
-				sv1.normal.x * ( 1 - wf ) + sv2.normal.x * wf,
-				sv1.normal.y * ( 1 - wf ) + sv2.normal.y * wf,
-				sv1.normal.z * ( 1 - wf ) + sv2.normal.z * wf,
-				0.f
-			};
+// immediate mode drawing writes the frame buffers from the calling thread, so everything flushed before has to
+// be rasterized first and the buffers pointed at the frame being recorded
+void Device::sync( )
+{
+	flush( );
+	if ( rasterQueue == NULL ) return;
 
-			Vertex p = { { ( float )i, v1.y, v1.z * ( 1 - wf ) + v2.z * wf, 1.f }, co, te, nor } ;
-			drawPoint2d( p );
-		}
+	rasterQueue->wait( );
+	setTarget( record->target );
+}
+
+void Device::setTarget( uint32* target )
+{
+	if ( framebuffer[0] == target ) return;
+	for ( int y = 0; y < height; y ++ )
+	{
+		framebuffer[y] = target + y * width;
 	}
-	else
+}
+
+void Device::resolveTile( int tile, bool depth )
+{
+	int x0 = ( tile % tilesX ) * RASTER_TILE;
+	int y0 = ( tile / tilesX ) * RASTER_TILE;
+	int x1 = std::min( x0 + RASTER_TILE, width );
+	int y1 = std::min( y0 + RASTER_TILE, height );
+
+	for ( int y = y0; y < y1; y ++ )
 	{
-		float diff = 0;
-		float dx = abs( sv1.pos.x - sv2.pos.x );
-		float dy = abs( sv1.pos.y - sv2.pos.y );
+		std::fill( framebuffer[y] + x0, framebuffer[y] + x1, CLEAR_COLOR );
+		if ( depth ) fillDepth( y * width + x0, x1 - x0, clearDepth );
+		if ( depth && sampleSlot != NULL ) std::fill( sampleSlot + y * width + x0, sampleSlot + y * width + x1, 0 );
+	}
 
-		if ( dx >= dy )
-		{
-			int j = ( int )v1.y;
-			int step = v2.x > v1.x ? 1 : -1;
-			for ( int i = ( int )v1.x; i != ( int )v2.x; i += step )
-			{
-				Vector pi = { ( float )i, ( float )j, 0, 1 };
-				float sf = VectorLength( pi - v1 ) / VectorLength( v2 - v1 );
-				float inv = 1 / ( sf / pv1.pos.w + ( 1 - sf ) / pv2.pos.w );
-				float wf = ( sf / pv1.pos.w ) * inv;
-
-				Color co = {
-					sv1.color.r * ( 1 - wf ) + sv2.color.r * wf,
-					sv1.color.g * ( 1 - wf ) + sv2.color.g * wf,
-					sv1.color.b * ( 1 - wf ) + sv2.color.b * wf
-				};
-
-				Texcoord te = {
-					sv1.tex.u * ( 1 - wf ) + sv2.tex.u * wf,
-					sv1.tex.v * ( 1 - wf ) + sv2.tex.v * wf
-				};
-
-				Vector nor = {
-					sv1.normal.x * ( 1 - wf ) + sv2.normal.x * wf,
-					sv1.normal.y * ( 1 - wf ) + sv2.normal.y * wf,
-					sv1.normal.z * ( 1 - wf ) + sv2.normal.z * wf,
-					0.f
-				};
-
-				Vertex p = { { ( float )i, ( float )j, v1.z * ( 1 - wf ) + v2.z * wf, 1.f }, co, te, nor } ;
-				drawPoint2d( p );
-
-				diff = diff + dy;
-				if ( diff >= dx )
-				{
-					diff -= dx;
-					j += ( v2.y > v1.y ? 1 : -1 );
-				}
-			}
-		}
-		else
+	if ( depth && sampleSlot != NULL ) sampleColors[tile].clear( );
+	if ( depth ) tileCleared[tile] = 0;
+}
+
+// averages the samples of every edge pixel into the color buffer, the other pixels already hold their color
+void Device::resolveSamples( int tile )
+{
+	// a tile nothing was drawn to is still logically cleared
+	if ( tileCleared[tile] ) return;
+
+	PROFILE_SCOPE( PROFILE_OUTPUT );
+
+	int x0 = ( tile % tilesX ) * RASTER_TILE;
+	int y0 = ( tile / tilesX ) * RASTER_TILE;
+	int x1 = std::min( x0 + RASTER_TILE, width );
+	int y1 = std::min( y0 + RASTER_TILE, height );
+
+	const std::vector<uint32>& store = sampleColors[tile];
+	uint32 count = ( uint32 )sampleCount, half = count / 2;
+	for ( int y = y0; y < y1; y ++ )
+	{
+		for ( int x = x0; x < x1; x ++ )
 		{
-			int j = ( int )v1.x;
-			int step = v2.y > v1.y ? 1 : -1;
-			for ( int i = ( int )v1.y; i != ( int )v2.y; i += step )
+			unsigned short slot = sampleSlot[y * width + x];
+			if ( !( slot & SAMPLE_EXPANDED ) ) continue;
+
+			const uint32* colors = &store[( size_t )( ( slot & SAMPLE_INDEX ) - 1 ) * count];
+			uint32 r = 0, g = 0, b = 0;
+			for ( uint32 s = 0; s < count; s ++ )
 			{
-				Vector pi = { ( float )j, ( float )i, 0, 1 };
-				float sf = VectorLength( pi - v1 ) / VectorLength( v2 - v1 );
-				float inv = 1 / ( sf / pv1.pos.w + ( 1 - sf ) / pv2.pos.w );
-				float wf = ( sf / pv1.pos.w ) * inv;
-
-				Color co = {
-					sv1.color.r * ( 1 - wf ) + sv2.color.r * wf,
-					sv1.color.g * ( 1 - wf ) + sv2.color.g * wf,
-					sv1.color.b * ( 1 - wf ) + sv2.color.b * wf
-				};
-
-				Texcoord te = {
-					sv1.tex.u * ( 1 - wf ) + sv2.tex.u * wf,
-					sv1.tex.v * ( 1 - wf ) + sv2.tex.v * wf
-				};
-
-				Vector nor = {
-					sv1.normal.x * ( 1 - wf ) + sv2.normal.x * wf,
-					sv1.normal.y * ( 1 - wf ) + sv2.normal.y * wf,
-					sv1.normal.z * ( 1 - wf ) + sv2.normal.z * wf,
-					0.f
-				};
-
-				Vertex p = { { ( float )j, ( float )i, v1.z * ( 1 - wf ) + v2.z * wf, 1.f }, co, te, nor } ;
-				drawPoint2d( p );
-
-				diff = diff + dx;
-				if ( diff >= dy )
-				{
-					diff -= dy;
-					j += ( v2.x > v1.x ? 1 : -1 );
-				}
+				r += ( colors[s] >> 16 ) & 0xff;
+				g += ( colors[s] >> 8 ) & 0xff;
+				b += colors[s] & 0xff;
 			}
+			framebuffer[y][x] = ( ( ( r + half ) / count ) << 16 ) | ( ( ( g + half ) / count ) << 8 ) | ( ( b + half ) / count );
 		}
 	}
 }
 
-void Device::drawTriangle3d( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3 )
+void Device::close( )
 {
-	if( wv1.pos.w != 1.0f ) return;
-	if( wv2.pos.w != 1.0f ) return;
-	if( wv3.pos.w != 1.0f ) return;
+	if ( rasterQueue != NULL )
+	{
+		finish( );
+		delete rasterQueue;
+		rasterQueue = NULL;
+	}
 
-	Vertex pv1 = wv1;
-	Vertex pv2 = wv2;
-	Vertex pv3 = wv3;
-
-	transform->applyWVP( pv1.pos, wv1.pos );
-	transform->applyWVP( pv2.pos, wv2.pos );
-	transform->applyWVP( pv3.pos, wv3.pos );
-
-	if ( checkCvv( pv1 ) ) return;
-	if ( checkCvv( pv2 ) ) return;
-	if ( checkCvv( pv3 ) ) return;
-
-	Vertex sv1 = pv1;
-	Vertex sv2 = pv2;
-	Vertex sv3 = pv3;
-	transform->homogenizeVert( sv1.pos, pv1.pos );
-	transform->homogenizeVert( sv2.pos, pv2.pos );
-	transform->homogenizeVert( sv3.pos, pv3.pos );
-
-	Vector v12 = sv2.pos - sv1.pos;
-	Vector v23 = sv3.pos - sv2.pos;
-	Vector cros;
-	VectorCrossProduct( cros, v23, v12 );
-	VectorNormalize( cros );
-	if ( ( Vector { 0.f, 0.f, -1.f, 0.f } * cros ) < 0 ) return;
+	if ( threadPool != NULL )
+	{
+		delete threadPool;
+		threadPool = NULL;
+	}
 
-	Vector min;
-	Vector max;
-	getMinAABB2d(min, sv1.pos, sv2.pos, sv3.pos);
-	getMaxAABB2d(max, sv1.pos, sv2.pos, sv3.pos);
+	for ( size_t i = 0; i < queuedBatches.size( ); i ++ ) delete queuedBatches[i].second;
+	for ( size_t i = 0; i < freeBatches.size( ); i ++ ) delete freeBatches[i];
+	queuedBatches.clear( );
+	freeBatches.clear( );
+	if ( record != NULL )
+	{
+		delete record;
+		record = NULL;
+	}
+	raster = NULL;
 
-	min.x = ( float )floor( min.x );
-	min.y = ( float )floor( min.y );
-	max.x = ( float )ceil( max.x );
-	max.y = ( float )ceil( max.y );
+	if ( colorBuffers != NULL )
+	{
+		free( colorBuffers );
+		colorBuffers = NULL;
+	}
 
-	float sf1, sf2;
-	for ( int j = ( int )min.y; j <= max.y; j ++ )
+	if ( framebuffer != NULL )
 	{
-		for ( int i = ( int )min.x; i <= max.x; i ++ )
-		{
-			Vector lerpPoint = { ( float )i, ( float )j, 0.f, 1.f };
-			if ( triInterp_Barycentric( sv1.pos, sv2.pos, sv3.pos, lerpPoint, sf1, sf2 ) )
-			{
-				float inv = 1 / ( sf1 / pv1.pos.w + sf2 / pv2.pos.w + ( 1 - sf1 - sf2 ) / pv3.pos.w );
-				float wf1 = ( sf1 / pv1.pos.w ) * inv, wf2 = ( sf2 / pv2.pos.w ) * inv;
-
-				Color co = {
-					sv1.color.r * wf1 + sv2.color.r * wf2 + sv3.color.r * ( 1 - wf1 - wf2 ),
-					sv1.color.g * wf1 + sv2.color.g * wf2 + sv3.color.g * ( 1 - wf1 - wf2 ),
-					sv1.color.b * wf1 + sv2.color.b * wf2 + sv3.color.b * ( 1 - wf1 - wf2 )
-				};
-
-				Texcoord te = {
-					sv1.tex.u * wf1 + sv2.tex.u * wf2 + sv3.tex.u * ( 1 - wf1 - wf2 ),
-					sv1.tex.v * wf1 + sv2.tex.v * wf2 + sv3.tex.v * ( 1 - wf1 - wf2 )
-				};
-
-				lerpPoint.z = sv1.pos.z * wf1 + sv2.pos.z * wf2 + sv3.pos.z * ( 1 - wf1 - wf2 );
-
-				Vector wnor = {
-					wv1.normal.x * wf1 + wv2.normal.x * wf2 + wv3.normal.x * ( 1 - wf1 - wf2 ),
-					wv1.normal.y * wf1 + wv2.normal.y * wf2 + wv3.normal.y * ( 1 - wf1 - wf2 ),
-					wv1.normal.z * wf1 + wv2.normal.z * wf2 + wv3.normal.z * ( 1 - wf1 - wf2 ),
-					0.0f
-				};
-				VectorNormalize( wnor );
-
-				Vector wpos = {
-					wv1.pos.x * wf1 + wv2.pos.x * wf2 + wv3.pos.x * ( 1 - wf1 - wf2 ),
-					wv1.pos.y * wf1 + wv2.pos.y * wf2 + wv3.pos.y * ( 1 - wf1 - wf2 ),
-					wv1.pos.z * wf1 + wv2.pos.z * wf2 + wv3.pos.z * ( 1 - wf1 - wf2 ),
-					1.0f
-				};
-
-				Vertex pDraw = { lerpPoint, co, te, wnor };
-
-				switch ( illuminationMode )
-				{
-					case IlluminationMode::COLOR:
-						break;
-					case IlluminationMode::DIFFUSE:
-						pDraw.color = diffusePS( pDraw, wnor );
-						break;
-					case IlluminationMode::PHONG:
-						pDraw.color = phonePS( pDraw, wnor, wpos, camEye );
-						break;
-					case IlluminationMode::BLINN:
-						pDraw.color = blinnPhonePS( pDraw, wnor, wpos, camEye );
-						break;
-					default:
-						break;
-				}
-				drawPoint2d( pDraw );
-			}
-		}
+		free( framebuffer );
+	}
+
+	if ( zbuffer != NULL )
+	{
+		free( zbuffer );
+	}
+
+	if ( gbufferNormal != NULL )
+	{
+		free( gbufferNormal );
+		gbufferNormal = NULL;
+	}
+
+	if ( sampleDepth != NULL )
+	{
+		free( sampleDepth );
+		free( sampleSlot );
+		sampleDepth = NULL;
+		sampleSlot = NULL;
+	}
+	sampleColors.clear( );
+
+	if ( tileCleared != NULL )
+	{
+		free( tileCleared );
+		tileCleared = NULL;
+	}
+
+	if ( hizBlockMin != NULL )
+	{
+		free( hizBlockMin );
+		free( hizBlockMax );
+		free( hizTileMax );
+		hizBlockMin = hizBlockMax = hizTileMax = NULL;
+	}
+
+	if ( vertexCache != NULL )
+	{
+		free( vertexCache );
+		free( vertexStreams );
+		vertexCache = NULL;
+		vertexStreams = NULL;
+		vertexCacheSize = 0;
+	}
+
+	if ( unpackedVertices != NULL )
+	{
+		free( unpackedVertices );
+		unpackedVertices = NULL;
+		unpackedSize = 0;
+		unpackedMesh = NULL;
 	}
 }
 
-bool Device::checkCvv( const Vertex& pv )
+void Device::drawPoint2d( const Vertex& sv )
 {
-	float w = pv.pos.w;
-	int check = 0;
-	if ( pv.pos.z < 0.0f ) check |= 1;
-	if ( pv.pos.z > w ) check |= 2;
-	if ( pv.pos.x < - w ) check |= 4;
-	if ( pv.pos.x > w ) check |= 8;
-	if ( pv.pos.y < - w ) check |= 16;
-	if ( pv.pos.y > w ) check |= 32;
+	sync( );
 
-	return check != 0;
+	// plotPoint tests keys like the triangles and lines that end up in it
+	Vertex p = sv;
+	p.pos.z = getDepthKey( sv.pos.z );
+	plotPoint( p );
 }
 
-bool Device::triInterp_Barycentric( const Vector& v1, const Vector& v2, const Vector& v3, const Vector& p, float& u, float& v )
+bool Device::plotPoint( const Vertex& sv )
 {
-	float num, inv;
+	int y = ( int )sv.pos.y;
+	int x = ( int )sv.pos.x;
 
-	num = - ( p.x - v2.x ) * ( v3.y - v2.y ) + ( p.y - v2.y ) * ( v3.x - v2.x );
-	inv = - ( v1.x - v2.x ) * ( v3.y - v2.y ) + ( v1.y - v2.y ) * ( v3.x - v2.x );
-	u = num / inv;
+	if ( y < 0 || y >= height ) return false;
+	if ( x < 0 || x >= width ) return false;
 
-	num = - ( p.x - v3.x ) * ( v1.y - v3.y ) + ( p.y - v3.y ) * ( v1.x - v3.x );
-	inv = - ( v2.x - v3.x ) * ( v1.y - v3.y ) + ( v2.y - v3.y ) * ( v1.x - v3.x );
-	v = num / inv;
+	PROFILE_SCOPE( PROFILE_OUTPUT );
+	PROFILE_COUNT( PROFILE_PIXELS_TESTED, 1 );
 
-	if( u + v > 1 )
+	int tile = ( y / RASTER_TILE ) * tilesX + x / RASTER_TILE;
+	if ( tileCleared[tile] ) resolveTile( tile, true );
+
+	float z = roundDepth( sv.pos.z );
+	if ( depthAt( y * width + x ) < z )
 		return false;
 
-	return ( u >= 0 && u <= 1 ) && ( v >= 0 && v <= 1 );
+	PROFILE_COUNT( PROFILE_PIXELS_SHADED, 1 );
+	PROFILE_COUNT( PROFILE_OVERDRAW, depthAt( y * width + x ) != clearDepth );
+
+	int r = sv.color.r > 1 ? 255 : ( int )( sv.color.r * 255 );
+	int g = sv.color.g > 1 ? 255 : ( int )( sv.color.g * 255 );
+	int b = sv.color.b > 1 ? 255 : ( int )( sv.color.b * 255 );
+
+	int hexColor = ( r << 16 ) | ( g << 8 ) | b;
+
+	framebuffer[y][x] = hexColor;
+	setDepth( y * width + x, z );
+
+	// the block max only ever gets more conservative when depth decreases, the min has to follow
+	float& zmin = hizBlockMin[( y / RASTER_BLOCK ) * blocksX + x / RASTER_BLOCK];
+	zmin = std::min( zmin, z );
+	return true;
+}
+
+void Device::drawLine3d( const Vertex& wv1, const Vertex& wv2 )
+{
+	sync( );
+
+	if( wv1.pos.w != 1.0f ) return;
+	if( wv2.pos.w != 1.0f ) return;
+
+	Vector c1, c2;
+	transform->applyWVP( c1, wv1.pos );
+	transform->applyWVP( c2, wv2.pos );
+	rasterLine( wv1, wv2, c1, c2 );
+}
+
+void Device::drawLines( const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount )
+{
+	sync( );
+	transformVertices( vertices, vertexCount );
+
+	for ( int i = 0; i + 1 < indexCount; i += 2 )
+	{
+		uint32 i1 = indices[i], i2 = indices[i + 1];
+		if ( i1 >= ( uint32 )vertexCount || i2 >= ( uint32 )vertexCount ) continue;
+
+		const TransformedVertex& tv1 = vertexCache[i1];
+		const TransformedVertex& tv2 = vertexCache[i2];
+		if ( tv1.culled || tv2.culled || ( tv1.clipCode & tv2.clipCode ) != 0 ) continue;
+
+		rasterLine( vertices[i1], vertices[i2], tv1.clip, tv2.clip );
+	}
+}
+
+void Device::rasterLine( const Vertex& wv1, const Vertex& wv2, const Vector& clip1, const Vector& clip2 )
+{
+	Vertex pv1 = wv1;
+	Vertex pv2 = wv2;
+	pv1.pos = clip1;
+	pv2.pos = clip2;
+
+	// clip the segment to the view volume instead of dropping it when an end point leaves it
+	bool reversed = depthFormat == DepthFormat::FLOAT32_REVERSED;
+	float t0 = 0.f, t1 = 1.f;
+	for ( int k = 0; k < CLIP_GUARD_LEFT; k ++ )
+	{
+		float d1 = ClipDistance( pv1.pos, k, reversed ), d2 = ClipDistance( pv2.pos, k, reversed );
+		if ( d1 < 0.f && d2 < 0.f ) return;
+		if ( d1 < 0.f ) t0 = std::max( t0, d1 / ( d1 - d2 ) );
+		else if ( d2 < 0.f ) t1 = std::min( t1, d1 / ( d1 - d2 ) );
+	}
+	if ( t0 > t1 ) return;
+
+	if ( t0 > 0.f || t1 < 1.f )
+	{
+		Vertex cv1 = InterpVertex( pv1, pv2, t0 );
+		Vertex cv2 = InterpVertex( pv1, pv2, t1 );
+		pv1 = cv1;
+		pv2 = cv2;
+	}
+
+	Vector s1, s2;
+	transform->homogenizeVert( s1, pv1.pos );
+	transform->homogenizeVert( s2, pv2.pos );
+
+	int x = ( int )floor( s1.x ), y = ( int )floor( s1.y );
+	int x2 = ( int )floor( s2.x ), y2 = ( int )floor( s2.y );
+	int dx = abs( x2 - x ), dy = abs( y2 - y );
+	int sx = x < x2 ? 1 : -1, sy = y < y2 ? 1 : -1;
+
+	// every step moves one pixel along the major axis, the end pixel is left to the next segment
+	int steps = std::max( dx, dy );
+	if ( steps == 0 )
+	{
+		Vertex p = pv1;
+		p.pos = { ( float )x, ( float )y, getDepthKey( s1.z ), 1.f };
+		plotPoint( p );
+		return;
+	}
+
+	// 1 / w, attribute / w and screen z are affine in screen space, so they are stepped by constant deltas
+	const int ATTRIBS = 8;
+	float rhw1 = 1.f / pv1.pos.w, rhw2 = 1.f / pv2.pos.w;
+	float a1[ATTRIBS] = { pv1.color.r, pv1.color.g, pv1.color.b, pv1.tex.u, pv1.tex.v, pv1.normal.x, pv1.normal.y, pv1.normal.z };
+	float a2[ATTRIBS] = { pv2.color.r, pv2.color.g, pv2.color.b, pv2.tex.u, pv2.tex.v, pv2.normal.x, pv2.normal.y, pv2.normal.z };
+	float attr[ATTRIBS], step[ATTRIBS];
+	float inv = 1.f / steps;
+	for ( int k = 0; k < ATTRIBS; k ++ )
+	{
+		attr[k] = a1[k] * rhw1;
+		step[k] = ( a2[k] * rhw2 - attr[k] ) * inv;
+	}
+	float rhw = rhw1, rhwStep = ( rhw2 - rhw1 ) * inv;
+	float z = getDepthKey( s1.z ), zStep = ( getDepthKey( s2.z ) - z ) * inv;
+
+	int err = dx - dy;
+	for ( int i = 0; i < steps; i ++ )
+	{
+		float w = 1.f / rhw;
+		Vertex p = {
+			{ ( float )x, ( float )y, z, 1.f },
+			{ attr[0] * w, attr[1] * w, attr[2] * w },
+			{ attr[3] * w, attr[4] * w },
+			{ attr[5] * w, attr[6] * w, attr[7] * w, 0.f }
+		};
+		plotPoint( p );
+
+		int e2 = 2 * err;
+		if ( e2 > - dy ) { err -= dy; x += sx; }
+		if ( e2 < dx ) { err += dx; y += sy; }
+
+		for ( int k = 0; k < ATTRIBS; k ++ ) attr[k] += step[k];
+		rhw += rhwStep;
+		z += zStep;
+	}
+}
+
+void Device::drawTriangle3d( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3 )
+{
+	TransformedVertex tv1, tv2, tv3;
+	transformVertex( tv1, wv1 );
+	if ( tv1.culled ) return;
+	transformVertex( tv2, wv2 );
+	if ( tv2.culled ) return;
+	transformVertex( tv3, wv3 );
+	if ( tv3.culled ) return;
+
+	submitTriangle( wv1, wv2, wv3, tv1, tv2, tv3 );
+}
+
+template<class Index>
+void Device::drawIndexed( const Vertex* vertices, int vertexCount, const Index* indices, int indexCount )
+{
+	transformVertices( vertices, vertexCount );
+
+	for ( int i = 0; i + 2 < indexCount; i += 3 )
+	{
+		uint32 i1 = indices[i], i2 = indices[i + 1], i3 = indices[i + 2];
+		if ( i1 >= ( uint32 )vertexCount || i2 >= ( uint32 )vertexCount || i3 >= ( uint32 )vertexCount ) continue;
+
+		const TransformedVertex& tv1 = vertexCache[i1];
+		const TransformedVertex& tv2 = vertexCache[i2];
+		const TransformedVertex& tv3 = vertexCache[i3];
+		if ( tv1.culled || tv2.culled || tv3.culled ) continue;
+
+		submitTriangle( vertices[i1], vertices[i2], vertices[i3], tv1, tv2, tv3 );
+	}
+}
+
+void Device::drawMesh( const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount )
+{
+	drawIndexed( vertices, vertexCount, indices, indexCount );
+}
+
+void Device::drawMesh( const Vertex* vertices, int vertexCount, const uint16* indices, int indexCount )
+{
+	drawIndexed( vertices, vertexCount, indices, indexCount );
+}
+
+void Device::drawMesh( const PackedMesh& mesh )
+{
+	if ( &mesh != unpackedMesh )
+	{
+		PROFILE_SCOPE( PROFILE_VERTEX );
+		if ( mesh.vertexCount > unpackedSize )
+		{
+			free( unpackedVertices );
+			unpackedVertices = ( Vertex* )malloc( mesh.vertexCount * sizeof( Vertex ) );
+			unpackedSize = mesh.vertexCount;
+		}
+		UnpackVertices( unpackedVertices, mesh, 0, mesh.vertexCount );
+		unpackedMesh = &mesh;
+	}
+
+	if ( mesh.indexSize == 2 )
+		drawIndexed( unpackedVertices, mesh.vertexCount, mesh.getIndices16( ), mesh.indexCount );
+	else
+		drawIndexed( unpackedVertices, mesh.vertexCount, mesh.getIndices32( ), mesh.indexCount );
+}
+
+void Device::transformVertices( const Vertex* vertices, int vertexCount )
+{
+	PROFILE_SCOPE( PROFILE_VERTEX );
+
+	if ( vertexCount > vertexCacheSize )
+	{
+		free( vertexCache );
+		free( vertexStreams );
+		vertexCache = ( TransformedVertex* )malloc( vertexCount * sizeof( TransformedVertex ) );
+		vertexStreams = ( float* )malloc( 12 * vertexCount * sizeof( float ) );
+		vertexCacheSize = vertexCount;
+
+		VectorSoA* streams[3] = { &streamPos, &streamClip, &streamScreen };
+		for ( int s = 0; s < 3; s ++ )
+		{
+			float* base = vertexStreams + 4 * s * vertexCount;
+			*streams[s] = { base, base + vertexCount, base + 2 * vertexCount, base + 3 * vertexCount };
+		}
+	}
+
+	// same results as transformVertex, but the whole buffer goes through the SoA batch kernels
+	VectorSoAGather( streamPos, &vertices[0].pos, sizeof( Vertex ), vertexCount );
+	transform->applyWVPBatch( streamClip, streamPos, vertexCount );
+	transform->homogenizeBatch( streamScreen, streamClip, vertexCount );
+
+	bool reversed = depthFormat == DepthFormat::FLOAT32_REVERSED;
+	for ( int i = 0; i < vertexCount; i ++ )
+	{
+		TransformedVertex& tv = vertexCache[i];
+		tv.clip = { streamClip.x[i], streamClip.y[i], streamClip.z[i], streamClip.w[i] };
+		tv.screen = { streamScreen.x[i], streamScreen.y[i], streamScreen.z[i], streamScreen.w[i] };
+		tv.clipCode = ClipCode( tv.clip, reversed );
+		tv.culled = streamPos.w[i] != 1.0f;
+	}
+}
+
+void Device::submitTriangle( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3,
+	const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 )
+{
+	PROFILE_SCOPE( PROFILE_CLIP );
+	PROFILE_COUNT( PROFILE_TRIANGLES, 1 );
+
+	// all three vertices outside the same plane
+	if ( ( tv1.clipCode & tv2.clipCode & tv3.clipCode ) != 0 )
+	{
+		PROFILE_COUNT( PROFILE_CVV_REJECTED, 1 );
+		return;
+	}
+
+	if ( ( ( tv1.clipCode | tv2.clipCode | tv3.clipCode ) & CLIP_TRIANGLE_MASK ) != 0 )
+	{
+		PROFILE_COUNT( PROFILE_CLIPPED, 1 );
+		clipTriangle( wv1, wv2, wv3, tv1, tv2, tv3 );
+		return;
+	}
+
+	record->triangles.emplace_back( );
+	if ( setupTriangle( record->triangles.back( ), wv1, wv2, wv3, tv1, tv2, tv3 ) )
+	{
+		binTriangle( ( uint32 )record->triangles.size( ) - 1 );
+	}
+	else
+	{
+		record->triangles.pop_back( );
+	}
+}
+
+void Device::clipTriangle( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3,
+	const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 )
+{
+	// sutherland-hodgman in homogeneous space, the world space vertex rides along with the clip position;
+	// every plane adds at most one vertex to the polygon
+	const int maxVerts = 3 + CLIP_PLANES;
+	Vertex wv[2][maxVerts];
+	Vector cv[2][maxVerts];
+	int count = 3, cur = 0;
+	wv[0][0] = wv1; wv[0][1] = wv2; wv[0][2] = wv3;
+	cv[0][0] = tv1.clip; cv[0][1] = tv2.clip; cv[0][2] = tv3.clip;
+
+	bool reversed = depthFormat == DepthFormat::FLOAT32_REVERSED;
+	int planes = ( tv1.clipCode | tv2.clipCode | tv3.clipCode ) & CLIP_TRIANGLE_MASK;
+	for ( int k = 0; k < CLIP_PLANES && count >= 3; k ++ )
+	{
+		if ( ( planes & ( 1 << k ) ) == 0 ) continue;
+
+		int out = 0;
+		for ( int i = 0; i < count; i ++ )
+		{
+			int j = i + 1 == count ? 0 : i + 1;
+			float di = ClipDistance( cv[cur][i], k, reversed ), dj = ClipDistance( cv[cur][j], k, reversed );
+			if ( di >= 0.f )
+			{
+				wv[1 - cur][out] = wv[cur][i];
+				cv[1 - cur][out] = cv[cur][i];
+				out ++;
+			}
+			if ( ( di >= 0.f ) != ( dj >= 0.f ) )
+			{
+				float t = di / ( di - dj );
+				wv[1 - cur][out] = InterpVertex( wv[cur][i], wv[cur][j], t );
+				cv[1 - cur][out] = InterpVector( cv[cur][i], cv[cur][j], t );
+				out ++;
+			}
+		}
+		count = out;
+		cur = 1 - cur;
+	}
+	if ( count < 3 ) return;
+
+	TransformedVertex tv[maxVerts];
+	for ( int i = 0; i < count; i ++ )
+	{
+		tv[i].clip = cv[cur][i];
+		transform->homogenizeVert( tv[i].screen, cv[cur][i] );
+		tv[i].clipCode = 0;
+		tv[i].culled = false;
+	}
+
+	// the clipped polygon is convex and keeps the winding of the triangle, so fan it from the first vertex
+	for ( int i = 1; i + 1 < count; i ++ )
+	{
+		record->triangles.emplace_back( );
+		if ( setupTriangle( record->triangles.back( ), wv[cur][0], wv[cur][i], wv[cur][i + 1], tv[0], tv[i], tv[i + 1] ) )
+		{
+			binTriangle( ( uint32 )record->triangles.size( ) - 1 );
+		}
+		else
+		{
+			record->triangles.pop_back( );
+		}
+	}
+}
+
+void Device::projectVertex( TransformedVertex& tv, const Vector& clip )
+{
+	tv.clip = clip;
+	tv.clipCode = ClipCode( clip, depthFormat == DepthFormat::FLOAT32_REVERSED );
+	tv.culled = false;
+	if ( ( tv.clipCode & ( 1 << CLIP_NEAR ) ) == 0 )
+	{
+		transform->homogenizeVert( tv.screen, clip );
+	}
+}
+
+void Device::beginShaded( const void* shader, ShadeGroupFunc shade, int count )
+{
+	// fixed function triangles still in the bins were drawn before this call
+	sync( );
+
+	shaderContext = shader;
+	shadeGroup = shade;
+	varyingCount = count;
+	varyingPlanes.clear( );
+}
+
+void Device::endShaded( )
+{
+	if ( !record->triangles.empty( ) )
+	{
+		record->rasterFunc = &Device::rasterShaded;
+		executeBatch( record );
+	}
+	shaderContext = NULL;
+	shadeGroup = NULL;
+}
+
+void Device::submitShaded( const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3,
+	const float* va1, const float* va2, const float* va3 )
+{
+	PROFILE_SCOPE( PROFILE_CLIP );
+	PROFILE_COUNT( PROFILE_TRIANGLES, 1 );
+
+	if ( ( tv1.clipCode & tv2.clipCode & tv3.clipCode ) != 0 )
+	{
+		PROFILE_COUNT( PROFILE_CVV_REJECTED, 1 );
+		return;
+	}
+
+	if ( ( ( tv1.clipCode | tv2.clipCode | tv3.clipCode ) & CLIP_TRIANGLE_MASK ) != 0 )
+	{
+		PROFILE_COUNT( PROFILE_CLIPPED, 1 );
+		clipShaded( tv1, tv2, tv3, va1, va2, va3 );
+		return;
+	}
+
+	setupShaded( tv1, tv2, tv3, va1, va2, va3 );
+}
+
+void Device::clipShaded( const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3,
+	const float* va1, const float* va2, const float* va3 )
+{
+	// same polygon clipper as clipTriangle, with the varyings as the attributes riding along
+	const int maxVerts = 3 + CLIP_PLANES;
+	float va[2][maxVerts][MAX_VARYINGS];
+	Vector cv[2][maxVerts];
+	int count = 3, cur = 0;
+	cv[0][0] = tv1.clip; cv[0][1] = tv2.clip; cv[0][2] = tv3.clip;
+	memcpy( va[0][0], va1, varyingCount * sizeof( float ) );
+	memcpy( va[0][1], va2, varyingCount * sizeof( float ) );
+	memcpy( va[0][2], va3, varyingCount * sizeof( float ) );
+
+	bool reversed = depthFormat == DepthFormat::FLOAT32_REVERSED;
+	int planes = ( tv1.clipCode | tv2.clipCode | tv3.clipCode ) & CLIP_TRIANGLE_MASK;
+	for ( int k = 0; k < CLIP_PLANES && count >= 3; k ++ )
+	{
+		if ( ( planes & ( 1 << k ) ) == 0 ) continue;
+
+		int out = 0;
+		for ( int i = 0; i < count; i ++ )
+		{
+			int j = i + 1 == count ? 0 : i + 1;
+			float di = ClipDistance( cv[cur][i], k, reversed ), dj = ClipDistance( cv[cur][j], k, reversed );
+			if ( di >= 0.f )
+			{
+				memcpy( va[1 - cur][out], va[cur][i], varyingCount * sizeof( float ) );
+				cv[1 - cur][out] = cv[cur][i];
+				out ++;
+			}
+			if ( ( di >= 0.f ) != ( dj >= 0.f ) )
+			{
+				float t = di / ( di - dj );
+				for ( int n = 0; n < varyingCount; n ++ ) va[1 - cur][out][n] = interp( va[cur][i][n], va[cur][j][n], t );
+				cv[1 - cur][out] = InterpVector( cv[cur][i], cv[cur][j], t );
+				out ++;
+			}
+		}
+		count = out;
+		cur = 1 - cur;
+	}
+	if ( count < 3 ) return;
+
+	TransformedVertex tv[maxVerts];
+	for ( int i = 0; i < count; i ++ )
+	{
+		projectVertex( tv[i], cv[cur][i] );
+	}
+
+	for ( int i = 1; i + 1 < count; i ++ )
+	{
+		setupShaded( tv[0], tv[i], tv[i + 1], va[cur][0], va[cur][i], va[cur][i + 1] );
+	}
+}
+
+// plane equation of the attribute that takes the values f1, f2, f3 at the vertices of the set up triangle
+static inline void SetPlane( float* plane, const TriangleSetup& ts, float f1, float f2, float f3 )
+{
+	plane[0] = f1 * ts.a[0] + f2 * ts.a[1] + f3 * ts.a[2];
+	plane[1] = f1 * ts.b[0] + f2 * ts.b[1] + f3 * ts.b[2];
+	plane[2] = f1 * ts.c[0] + f2 * ts.c[1] + f3 * ts.c[2];
+}
+
+void Device::setupShaded( const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3,
+	const float* va1, const float* va2, const float* va3 )
+{
+	record->triangles.emplace_back( );
+	TriangleSetup& ts = record->triangles.back( );
+	if ( !setupTriangle( ts, tv1, tv2, tv3 ) )
+	{
+		record->triangles.pop_back( );
+		return;
+	}
+
+	// 1 / w, depth and varying / w are all affine in screen space, so each gets a plane a * x + b * y + c here
+	// and a pixel pays two multiply-adds per varying plus one divide shared by all of them
+	ts.planes = ( int )varyingPlanes.size( );
+	varyingPlanes.resize( varyingPlanes.size( ) + 3 * ( varyingCount + 2 ) );
+	float* plane = &varyingPlanes[ts.planes];
+	SetPlane( plane, ts, ts.rhw[0], ts.rhw[1], ts.rhw[2] );
+	SetPlane( plane + 3, ts, ts.z[0], ts.z[1], ts.z[2] );
+	for ( int n = 0; n < varyingCount; n ++ )
+	{
+		SetPlane( plane + 3 * ( n + 2 ), ts, va1[n] * ts.rhw[0], va2[n] * ts.rhw[1], va3[n] * ts.rhw[2] );
+	}
+
+	binTriangle( ( uint32 )record->triangles.size( ) - 1 );
+}
+
+void Device::binTriangle( uint32 index )
+{
+	PROFILE_SCOPE( PROFILE_SETUP );
+
+	const TriangleSetup& ts = record->triangles[index];
+
+	int tx0 = ts.minX / RASTER_TILE;
+	int ty0 = ts.minY / RASTER_TILE;
+	int tx1 = ts.maxX / RASTER_TILE;
+	int ty1 = ts.maxY / RASTER_TILE;
+
+	for ( int ty = ty0; ty <= ty1; ty ++ )
+	{
+		for ( int tx = tx0; tx <= tx1; tx ++ )
+		{
+			// skip tiles the bbox overlaps but the triangle itself misses
+			bool inside;
+			if ( EdgeTestRect( ts, tx * RASTER_TILE, ty * RASTER_TILE, RASTER_TILE, inside, sampleCount > 1 ? SAMPLE_MARGIN : 0 ) )
+			{
+				record->bins[ty * tilesX + tx].push_back( index );
+			}
+		}
+	}
+}
+
+// the variants are only ever reached through this table, which also instantiates them
+template<IlluminationMode MODE>
+static inline Device::RasterFunc SelectRaster( bool textured, bool simd )
+{
+	if ( textured ) return simd ? &Device::rasterTriangle<MODE, true, true> : &Device::rasterTriangle<MODE, true, false>;
+	return simd ? &Device::rasterTriangle<MODE, false, true> : &Device::rasterTriangle<MODE, false, false>;
+}
+
+// multisampled variants shade on the SIMD path only
+template<IlluminationMode MODE>
+static inline Device::RasterFunc SelectRaster( bool textured, bool simd, int samples )
+{
+	if ( samples == 4 ) return textured ? &Device::rasterMultisample<MODE, true, 4> : &Device::rasterMultisample<MODE, false, 4>;
+	if ( samples == 8 ) return textured ? &Device::rasterMultisample<MODE, true, 8> : &Device::rasterMultisample<MODE, false, 8>;
+	return SelectRaster<MODE>( textured, simd );
+}
+
+static inline Device::RasterFunc SelectDepthRaster( bool simd )
+{
+	return simd ? &Device::rasterDepth<true> : &Device::rasterDepth<false>;
+}
+
+void Device::flush( )
+{
+	Batch* batch = record;
+	if ( batch->triangles.empty( ) && !batch->clear && !batch->present ) return;
+
+	// mode, texture and shading path are fixed for the whole flush, so they are dispatched here instead of per pixel
+	switch ( illuminationMode )
+	{
+		case IlluminationMode::COLOR:
+			batch->rasterFunc = SelectRaster<IlluminationMode::COLOR>( texture != NULL, simdShading, sampleCount );
+			break;
+		case IlluminationMode::DIFFUSE:
+			batch->rasterFunc = SelectRaster<IlluminationMode::DIFFUSE>( texture != NULL, simdShading, sampleCount );
+			break;
+		case IlluminationMode::PHONG:
+			batch->rasterFunc = SelectRaster<IlluminationMode::PHONG>( texture != NULL, simdShading, sampleCount );
+			break;
+		case IlluminationMode::DEFERRED:
+			batch->rasterFunc = SelectRaster<IlluminationMode::DEFERRED>( texture != NULL, simdShading );
+			break;
+		default:
+			batch->rasterFunc = SelectRaster<IlluminationMode::BLINN>( texture != NULL, simdShading, sampleCount );
+			break;
+	}
+	if ( depthOnly ) batch->rasterFunc = SelectDepthRaster( simdShading );
+	batch->texture = texture;
+	batch->textureFilter = textureFilter;
+	if ( light != NULL ) batch->light = *light;
+	batch->camEye = camEye;
+
+	// a frame with any deferred triangles is lit once at present( ), with the camera and lights of that moment
+	if ( illuminationMode == IlluminationMode::DEFERRED && !depthOnly && !batch->triangles.empty( ) ) deferredFrame = true;
+	if ( batch->present && deferredFrame )
+	{
+		batch->deferred = true;
+		transform->getViewProjection( batch->viewProjection );
+		MatrixInverse( batch->inverseViewProjection, batch->viewProjection );
+		batch->lights.clear( );
+		if ( light != NULL ) batch->lights.push_back( *light );
+		batch->lights.insert( batch->lights.end( ), extraLights, extraLights + extraLightCount );
+		batch->pointLights.assign( pointLights, pointLights + pointLightCount );
+		deferredFrame = false;
+	}
+
+	if ( rasterQueue == NULL )
+	{
+		executeBatch( batch );
+		return;
+	}
+
+	// the raster thread owns the batch from here on, drawing continues into a fresh one for the same frame
+	unsigned long long ticket = rasterQueue->push( [this, batch]( ) { executeBatch( batch ); } );
+	queuedBatches.push_back( { ticket, batch } );
+	record = newBatch( );
+	record->target = batch->target;
+}
+
+Device::Batch* Device::newBatch( )
+{
+	// batches the raster thread is done with are reused along with the capacity of their vectors
+	while ( !queuedBatches.empty( ) && rasterQueue->isDone( queuedBatches.front( ).first ) )
+	{
+		freeBatches.push_back( queuedBatches.front( ).second );
+		queuedBatches.pop_front( );
+	}
+
+	Batch* batch;
+	if ( !freeBatches.empty( ) )
+	{
+		batch = freeBatches.back( );
+		freeBatches.pop_back( );
+	}
+	else
+	{
+		batch = new Batch( );
+		batch->bins.assign( tilesX * tilesY, std::vector<uint32>( ) );
+	}
+	return batch;
+}
+
+// the raster side of a batch, on the calling thread without a pipeline and on the raster thread with one
+void Device::executeBatch( Batch* batch )
+{
+	raster = batch;
+	setTarget( batch->target );
+
+	// with fast clear only the tile flags are set here, a tile is filled when it is first written or at present( )
+	if ( batch->clear )
+	{
+		for ( int i = 0; i < tilesX * tilesY; i ++ )
+		{
+			tileCleared[i] = 1;
+			if ( !fastClear ) resolveTile( i, true );
+		}
+
+		for ( int i = 0; i < blocksX * blocksY; i ++ )
+		{
+			hizBlockMin[i] = clearDepth;
+			hizBlockMax[i] = clearDepth;
+		}
+		for ( int i = 0; i < tilesX * tilesY; i ++ )
+		{
+			hizTileMax[i] = clearDepth;
+		}
+	}
+
+	if ( !batch->triangles.empty( ) )
+	{
+		threadPool->run( tilesX * tilesY, [this]( int tile ) { rasterTile( tile ); } );
+	}
+
+	// untouched tiles only need their color, depth stays logically cleared behind the flag
+	if ( batch->present )
+	{
+		if ( batch->deferred )
+		{
+			threadPool->run( tilesX * tilesY, [this]( int tile ) { lightTile( tile ); } );
+		}
+		if ( sampleCount > 1 )
+		{
+			threadPool->run( tilesX * tilesY, [this]( int tile ) { resolveSamples( tile ); } );
+		}
+		for ( int i = 0; i < tilesX * tilesY; i ++ )
+		{
+			if ( tileCleared[i] ) resolveTile( i, false );
+		}
+	}
+
+	batch->triangles.clear( );
+	batch->clear = false;
+	batch->present = false;
+	batch->deferred = false;
+}
+
+void Device::rasterTile( int tile )
+{
+	std::vector<uint32>& bin = raster->bins[tile];
+	if ( bin.empty( ) ) return;
+
+	PROFILE_SCOPE( PROFILE_RASTER );
+
+	if ( tileCleared[tile] ) resolveTile( tile, true );
+
+	// every tile owns its rectangle of framebuffer and zbuffer, so tiles are rasterized without locking
+	int x0 = ( tile % tilesX ) * RASTER_TILE;
+	int y0 = ( tile / tilesX ) * RASTER_TILE;
+	int x1 = std::min( x0 + RASTER_TILE, width ) - 1;
+	int y1 = std::min( y0 + RASTER_TILE, height ) - 1;
+
+	// tile level of the depth pyramid, kept in sync with the block maxima lazily
+	bool dirty = true;
+	int written = 0;
+	for ( size_t i = 0; i < bin.size( ); i ++ )
+	{
+		const TriangleSetup& ts = raster->triangles[bin[i]];
+		if ( dirty )
+		{
+			float zmax = -1e30f;
+			for ( int by = y0 / RASTER_BLOCK; by <= y1 / RASTER_BLOCK; by ++ )
+				for ( int bx = x0 / RASTER_BLOCK; bx <= x1 / RASTER_BLOCK; bx ++ )
+					zmax = std::max( zmax, hizBlockMax[by * blocksX + bx] );
+			hizTileMax[tile] = zmax;
+			dirty = false;
+		}
+
+		// interpolated depth never leaves the range of the vertex depths, so the whole triangle is hidden here
+		if ( ts.zMin > hizTileMax[tile] ) continue;
+
+		int n = ( this->*raster->rasterFunc )( ts, x0, y0, x1, y1 );
+		dirty = n > 0;
+		written += n;
+	}
+	bin.clear( );
+	pixelsWritten += written;
+}
+
+void Device::transformVertex( TransformedVertex& tv, const Vertex& wv )
+{
+	PROFILE_SCOPE( PROFILE_VERTEX );
+
+	tv.culled = true;
+	if( wv.pos.w != 1.0f ) return;
+
+	transform->applyWVP( tv.clip, wv.pos );
+	tv.clipCode = ClipCode( tv.clip, depthFormat == DepthFormat::FLOAT32_REVERSED );
+	tv.culled = false;
+
+	// behind the near plane w may be zero or negative, such vertices only ever reach setup through clipTriangle
+	if ( ( tv.clipCode & ( 1 << CLIP_NEAR ) ) == 0 )
+	{
+		transform->homogenizeVert( tv.screen, tv.clip );
+	}
+}
+
+bool Device::setupTriangle( TriangleSetup& ts, const Vertex& wv1, const Vertex& wv2, const Vertex& wv3,
+	const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 )
+{
+	if ( !setupTriangle( ts, tv1, tv2, tv3 ) ) return false;
+	if ( depthOnly ) return true;
+
+	ts.v[0] = wv1;
+	ts.v[1] = wv2;
+	ts.v[2] = wv3;
+
+	// the deferred pass lights in world space, where the point lights and the positions it rebuilds from depth live
+	if ( illuminationMode == IlluminationMode::DEFERRED )
+	{
+		for ( int k = 0; k < 3; k ++ ) transform->applyWorldNormal( ts.v[k].normal, ts.v[k].normal );
+	}
+
+	// shadow map coordinates are affine in world space, so they interpolate with the same weights as the rest
+	bool lit = illuminationMode != IlluminationMode::COLOR && illuminationMode != IlluminationMode::DEFERRED;
+	if ( lit && light != NULL && light->shadow != NULL )
+	{
+		for ( int k = 0; k < 3; k ++ )
+		{
+			Vector pos;
+			transform->applyWorld( pos, ts.v[k].pos );
+			light->shadow->project( ts.shadow[k], pos );
+		}
+	}
+	return true;
+}
+
+bool Device::setupTriangle( TriangleSetup& ts, const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 )
+{
+	PROFILE_SCOPE( PROFILE_SETUP );
+
+	// snap to 16.8 fixed point; everything below works on the snapped positions, so coverage and weights agree
+	int X[3], Y[3];
+	const Vector* sv[3] = { &tv1.screen, &tv2.screen, &tv3.screen };
+	for ( int k = 0; k < 3; k ++ )
+	{
+		X[k] = ( int )floor( sv[k]->x * SUBPIXEL_SCALE + 0.5f );
+		Y[k] = ( int )floor( sv[k]->y * SUBPIXEL_SCALE + 0.5f );
+	}
+	Vector s1 = { X[0] / SUBPIXEL_SCALE, Y[0] / SUBPIXEL_SCALE, tv1.screen.z, 1.f };
+	Vector s2 = { X[1] / SUBPIXEL_SCALE, Y[1] / SUBPIXEL_SCALE, tv2.screen.z, 1.f };
+	Vector s3 = { X[2] / SUBPIXEL_SCALE, Y[2] / SUBPIXEL_SCALE, tv3.screen.z, 1.f };
+
+	// front faces wind clockwise on screen ( y down ), which is a positive doubled area here; back faces and
+	// triangles that collapse when snapped are dropped
+	long long area = ( long long )( X[1] - X[0] ) * ( Y[2] - Y[0] ) - ( long long )( Y[1] - Y[0] ) * ( X[2] - X[0] );
+	if ( area <= 0 )
+	{
+		PROFILE_COUNT( PROFILE_BACKFACE, 1 );
+		return false;
+	}
+
+	// edge k runs between the two other vertices and is positive on the side of vertex k; pixels exactly on an
+	// edge belong to the triangle only for top edges ( horizontal, interior below ) and left edges
+	for ( int k = 0; k < 3; k ++ )
+	{
+		int i = ( k + 1 ) % 3, j = ( k + 2 ) % 3;
+		ts.ea[k] = Y[i] - Y[j];
+		ts.eb[k] = X[j] - X[i];
+		ts.ec[k] = ( long long )( Y[j] - Y[i] ) * X[i] - ( long long )( X[j] - X[i] ) * Y[i];
+		bool topLeft = ts.ea[k] > 0 || ( ts.ea[k] == 0 && ts.eb[k] > 0 );
+		if ( !topLeft ) ts.ec[k] -= 1;
+	}
+
+	// edge functions normalized so that they evaluate to the barycentric weight of the opposite vertex
+	float area1 = ( s1.y - s2.y ) * ( s3.x - s2.x ) - ( s1.x - s2.x ) * ( s3.y - s2.y );
+	float area2 = ( s2.y - s3.y ) * ( s1.x - s3.x ) - ( s2.x - s3.x ) * ( s1.y - s3.y );
+	if ( area1 == 0.f || area2 == 0.f ) return false;
+
+	float inv1 = 1.f / area1, inv2 = 1.f / area2;
+	ts.a[0] = - ( s3.y - s2.y ) * inv1;
+	ts.b[0] = ( s3.x - s2.x ) * inv1;
+	ts.c[0] = ( s2.x * ( s3.y - s2.y ) - s2.y * ( s3.x - s2.x ) ) * inv1;
+	ts.a[1] = - ( s1.y - s3.y ) * inv2;
+	ts.b[1] = ( s1.x - s3.x ) * inv2;
+	ts.c[1] = ( s3.x * ( s1.y - s3.y ) - s3.y * ( s1.x - s3.x ) ) * inv2;
+	ts.a[2] = - ts.a[0] - ts.a[1];
+	ts.b[2] = - ts.b[0] - ts.b[1];
+	ts.c[2] = 1.f - ts.c[0] - ts.c[1];
+
+	Vector min;
+	Vector max;
+	getMinAABB2d( min, s1, s2, s3 );
+	getMaxAABB2d( max, s1, s2, s3 );
+	// pixels whose sample point, or any of their multisample positions, lies in the snapped bbox, clamped to the screen
+	int margin = sampleCount > 1 ? SAMPLE_MARGIN : 0;
+	ts.minX = std::max( ( std::min( { X[0], X[1], X[2] } ) - margin + ( 1 << SUBPIXEL_BITS ) - 1 ) >> SUBPIXEL_BITS, 0 );
+	ts.minY = std::max( ( std::min( { Y[0], Y[1], Y[2] } ) - margin + ( 1 << SUBPIXEL_BITS ) - 1 ) >> SUBPIXEL_BITS, 0 );
+	ts.maxX = std::min( ( std::max( { X[0], X[1], X[2] } ) + margin ) >> SUBPIXEL_BITS, width - 1 );
+	ts.maxY = std::min( ( std::max( { Y[0], Y[1], Y[2] } ) + margin ) >> SUBPIXEL_BITS, height - 1 );
+	if ( ts.minX > ts.maxX || ts.minY > ts.maxY ) return false;
+
+	// depth is set up as keys, the range rounded like every pixel's key so the hierarchical z agrees with them
+	ts.z[0] = getDepthKey( s1.z );
+	ts.z[1] = getDepthKey( s2.z );
+	ts.z[2] = getDepthKey( s3.z );
+	ts.zMin = roundDepth( std::min( { ts.z[0], ts.z[1], ts.z[2] } ) );
+	ts.zMax = roundDepth( std::max( { ts.z[0], ts.z[1], ts.z[2] } ) );
+	ts.rhw[0] = 1.f / tv1.clip.w;
+	ts.rhw[1] = 1.f / tv2.clip.w;
+	ts.rhw[2] = 1.f / tv3.clip.w;
+
+	return true;
+}
+
+template<IlluminationMode MODE, bool TEXTURED, bool SIMD>
+int Device::rasterTriangle( const TriangleSetup& ts, int x0, int y0, int x1, int y1 )
+{
+	x0 = std::max( x0, ts.minX );
+	y0 = std::max( y0, ts.minY );
+	x1 = std::min( x1, ts.maxX );
+	y1 = std::min( y1, ts.maxY );
+
+	int written = 0;
+
+	// blocks stay aligned to the screen grid and are always evaluated from their corner, so a pixel gets
+	// exactly the same weights whichever tile ( or none ) the triangle is clipped to
+	for ( int by = y0 & ~( RASTER_BLOCK - 1 ); by <= y1; by += RASTER_BLOCK )
+	{
+		int sy = std::max( by, y0 ), ey = std::min( by + RASTER_BLOCK - 1, y1 );
+		for ( int bx = x0 & ~( RASTER_BLOCK - 1 ); bx <= x1; bx += RASTER_BLOCK )
+		{
+			int sx = std::max( bx, x0 ), ex = std::min( bx + RASTER_BLOCK - 1, x1 );
+
+			// coarse depth test against the block before any interpolation or shading; a triangle entirely in
+			// front of everything in the block can skip the per pixel depth reads instead
+			int block = ( by / RASTER_BLOCK ) * blocksX + bx / RASTER_BLOCK;
+			if ( ts.zMin > hizBlockMax[block] ) continue;
+			bool depthTest = ts.zMax > hizBlockMin[block];
+			int blockWritten = 0;
+
+			// reject the block if it lies outside any edge, skip the per pixel test if it lies inside all of them
+			bool inside;
+			if ( !EdgeTestRect( ts, bx, by, RASTER_BLOCK, inside ) ) continue;
+
+			// coverage comes from the integer edges, the float weights are only used for interpolation
+			long long step1 = ( long long )ts.ea[0] * ( 1 << SUBPIXEL_BITS );
+			long long step2 = ( long long )ts.ea[1] * ( 1 << SUBPIXEL_BITS );
+			long long step3 = ( long long )ts.ea[2] * ( 1 << SUBPIXEL_BITS );
+			for ( int j = sy; j <= ey; j ++ )
+			{
+				float sf1 = ts.a[0] * bx + ts.b[0] * j + ts.c[0];
+				float sf2 = ts.a[1] * bx + ts.b[1] * j + ts.c[1];
+				long long e1 = EdgeAt( ts, 0, bx, j ), e2 = EdgeAt( ts, 1, bx, j ), e3 = EdgeAt( ts, 2, bx, j );
+
+				if ( SIMD )
+				{
+					for ( int gx = bx; gx <= ex; gx += SIMD_WIDTH )
+					{
+						int mask = 0;
+						for ( int l = 0; l < SIMD_WIDTH; l ++, e1 += step1, e2 += step2, e3 += step3 )
+						{
+							int i = gx + l;
+							if ( i >= sx && i <= ex && ( inside || ( ( e1 | e2 | e3 ) >= 0 ) ) ) mask |= 1 << l;
+						}
+						if ( mask == 0 ) continue;
+
+						vfloat offset = vramp( ) + vset1( ( float )( gx - bx ) );
+						vfloat w1 = vset1( sf1 ) + vset1( ts.a[0] ) * offset;
+						vfloat w2 = vset1( sf2 ) + vset1( ts.a[1] ) * offset;
+						blockWritten += MaskCount( shadeQuad<MODE, TEXTURED>( ts, gx, j, w1, w2, mask, depthTest ) );
+					}
+					continue;
+				}
+
+				for ( int i = bx; i <= ex; i ++ )
+				{
+					if ( i >= sx && ( inside || ( ( e1 | e2 | e3 ) >= 0 ) ) )
+					{
+						if ( shadePixel<MODE, TEXTURED>( ts, i, j, sf1, sf2 ) ) blockWritten ++;
+					}
+					sf1 += ts.a[0];
+					sf2 += ts.a[1];
+					e1 += step1;
+					e2 += step2;
+					e3 += step3;
+				}
+			}
+
+			if ( blockWritten )
+			{
+				updateHiZ( block );
+				written += blockWritten;
+			}
+		}
+	}
+
+	return written;
+}
+
+int Device::rasterShaded( const TriangleSetup& ts, int x0, int y0, int x1, int y1 )
+{
+	x0 = std::max( x0, ts.minX );
+	y0 = std::max( y0, ts.minY );
+	x1 = std::min( x1, ts.maxX );
+	y1 = std::min( y1, ts.maxY );
+
+	const float* plane = &varyingPlanes[ts.planes];
+	int written = 0;
+
+	// same block walk as rasterTriangle, pixels go to the shader SIMD_WIDTH at a time after the depth test
+	for ( int by = y0 & ~( RASTER_BLOCK - 1 ); by <= y1; by += RASTER_BLOCK )
+	{
+		int sy = std::max( by, y0 ), ey = std::min( by + RASTER_BLOCK - 1, y1 );
+		for ( int bx = x0 & ~( RASTER_BLOCK - 1 ); bx <= x1; bx += RASTER_BLOCK )
+		{
+			int sx = std::max( bx, x0 ), ex = std::min( bx + RASTER_BLOCK - 1, x1 );
+
+			int block = ( by / RASTER_BLOCK ) * blocksX + bx / RASTER_BLOCK;
+			if ( ts.zMin > hizBlockMax[block] ) continue;
+			bool depthTest = ts.zMax > hizBlockMin[block];
+			int blockWritten = 0;
+
+			bool inside;
+			if ( !EdgeTestRect( ts, bx, by, RASTER_BLOCK, inside ) ) continue;
+
+			long long step1 = ( long long )ts.ea[0] * ( 1 << SUBPIXEL_BITS );
+			long long step2 = ( long long )ts.ea[1] * ( 1 << SUBPIXEL_BITS );
+			long long step3 = ( long long )ts.ea[2] * ( 1 << SUBPIXEL_BITS );
+			for ( int j = sy; j <= ey; j ++ )
+			{
+				long long e1 = EdgeAt( ts, 0, bx, j ), e2 = EdgeAt( ts, 1, bx, j ), e3 = EdgeAt( ts, 2, bx, j );
+				for ( int gx = bx; gx <= ex; gx += SIMD_WIDTH )
+				{
+					int mask = 0;
+					float depth[SIMD_WIDTH] = { 0 }, zold[SIMD_WIDTH];
+					for ( int l = 0; l < SIMD_WIDTH; l ++, e1 += step1, e2 += step2, e3 += step3 )
+					{
+						int i = gx + l;
+						if ( i < sx || i > ex || !( inside || ( ( e1 | e2 | e3 ) >= 0 ) ) ) continue;
+						depth[l] = roundDepth( plane[3] * i + plane[4] * j + plane[5] );
+						mask |= 1 << l;
+					}
+					if ( mask != 0 && depthTest )
+					{
+						loadDepth( zold, j * width + gx, mask );
+						for ( int l = 0; l < SIMD_WIDTH; l ++ )
+						{
+							if ( ( ( mask >> l ) & 1 ) && zold[l] < depth[l] ) mask &= ~( 1 << l );
+						}
+					}
+					if ( mask == 0 ) continue;
+
+					uint32 colors[SIMD_WIDTH];
+					{
+						PROFILE_SCOPE( PROFILE_SHADE );
+						PROFILE_COUNT( PROFILE_PIXELS_SHADED, MaskCount( mask ) );
+						shadeGroup( shaderContext, plane, gx, j, mask, colors );
+					}
+
+					uint32* crow = framebuffer[j];
+					for ( int l = 0; l < SIMD_WIDTH; l ++ )
+					{
+						if ( ( mask >> l ) & 1 ) crow[gx + l] = colors[l];
+					}
+					storeDepth( j * width + gx, depth, mask );
+					blockWritten += MaskCount( mask );
+				}
+			}
+
+			if ( blockWritten )
+			{
+				updateHiZ( block );
+				written += blockWritten;
+			}
+		}
+	}
+
+	return written;
+}
+
+void Device::updateHiZ( int block )
+{
+	int bx = ( block % blocksX ) * RASTER_BLOCK, by = ( block / blocksX ) * RASTER_BLOCK;
+	int ex = std::min( bx + RASTER_BLOCK, width ), ey = std::min( by + RASTER_BLOCK, height );
+
+	float zmin = 1e30f, zmax = -1e30f;
+	if ( depthFormat == DepthFormat::UNORM16 ) DepthRange( ( const uint16* )zbuffer, width, bx, by, ex, ey, zmin, zmax );
+	else if ( depthFormat == DepthFormat::UNORM24 ) DepthRange( ( const int* )zbuffer, width, bx, by, ex, ey, zmin, zmax );
+	else DepthRange( ( const float* )zbuffer, width, bx, by, ex, ey, zmin, zmax );
+	hizBlockMin[block] = zmin;
+	hizBlockMax[block] = zmax;
+}
+
+// perspective correct texture coordinates at the pixel with barycentric weights sf1, sf2
+static inline void PerspectiveTexcoord( const TriangleSetup& ts, float sf1, float sf2, float& u, float& v )
+{
+	float p1 = sf1 * ts.rhw[0], p2 = sf2 * ts.rhw[1], p3 = ( 1.f - sf1 - sf2 ) * ts.rhw[2];
+	float inv = 1.f / ( p1 + p2 + p3 );
+	u = ( p1 * ts.v[0].tex.u + p2 * ts.v[1].tex.u + p3 * ts.v[2].tex.u ) * inv;
+	v = ( p1 * ts.v[0].tex.v + p2 * ts.v[1].tex.v + p3 * ts.v[2].tex.v ) * inv;
+}
+
+// mip level from the texture coordinate differences between a pixel and its right and lower neighbours
+static float TextureLod( const Texture* texture, const TriangleSetup& ts, float sf1, float sf2 )
+{
+	float u, v, ux, vx, uy, vy;
+	PerspectiveTexcoord( ts, sf1, sf2, u, v );
+	PerspectiveTexcoord( ts, sf1 + ts.a[0], sf2 + ts.a[1], ux, vx );
+	PerspectiveTexcoord( ts, sf1 + ts.b[0], sf2 + ts.b[1], uy, vy );
+	return texture->computeLod( ux - u, vx - v, uy - u, vy - v );
+}
+
+template<IlluminationMode MODE, bool TEXTURED>
+bool Device::shadePixel( const TriangleSetup& ts, int x, int y, float sf1, float sf2 )
+{
+	PROFILE_SCOPE( PROFILE_SHADE );
+
+	const Vertex& wv1 = ts.v[0];
+	const Vertex& wv2 = ts.v[1];
+	const Vertex& wv3 = ts.v[2];
+
+	float inv = 1 / ( sf1 * ts.rhw[0] + sf2 * ts.rhw[1] + ( 1 - sf1 - sf2 ) * ts.rhw[2] );
+	float wf1 = ( sf1 * ts.rhw[0] ) * inv, wf2 = ( sf2 * ts.rhw[1] ) * inv;
+
+	Color co = {
+		wv1.color.r * wf1 + wv2.color.r * wf2 + wv3.color.r * ( 1 - wf1 - wf2 ),
+		wv1.color.g * wf1 + wv2.color.g * wf2 + wv3.color.g * ( 1 - wf1 - wf2 ),
+		wv1.color.b * wf1 + wv2.color.b * wf2 + wv3.color.b * ( 1 - wf1 - wf2 )
+	};
+
+	// texcoords only feed the texture and the world position only the specular modes, the compiler drops
+	// whatever the variant never reads
+	Texcoord te = { 0.f, 0.f };
+	if ( TEXTURED )
+	{
+		te.u = wv1.tex.u * wf1 + wv2.tex.u * wf2 + wv3.tex.u * ( 1 - wf1 - wf2 );
+		te.v = wv1.tex.v * wf1 + wv2.tex.v * wf2 + wv3.tex.v * ( 1 - wf1 - wf2 );
+		co = co * raster->texture->sample( te.u, te.v, TextureLod( raster->texture, ts, sf1, sf2 ), raster->textureFilter );
+	}
+
+	Vector lerpPoint = { ( float )x, ( float )y, 0.f, 1.f };
+	// z / w is affine on screen, so depth takes the screen space weights rather than the perspective correct ones
+	lerpPoint.z = ts.z[0] * sf1 + ts.z[1] * sf2 + ts.z[2] * ( 1 - sf1 - sf2 );
+
+	Vector wnor = { 0.f, 0.f, 0.f, 0.f };
+	if ( MODE != IlluminationMode::COLOR )
+	{
+		wnor.x = wv1.normal.x * wf1 + wv2.normal.x * wf2 + wv3.normal.x * ( 1 - wf1 - wf2 );
+		wnor.y = wv1.normal.y * wf1 + wv2.normal.y * wf2 + wv3.normal.y * ( 1 - wf1 - wf2 );
+		wnor.z = wv1.normal.z * wf1 + wv2.normal.z * wf2 + wv3.normal.z * ( 1 - wf1 - wf2 );
+		VectorNormalize( wnor );
+	}
+
+	Vector wpos = { 0.f, 0.f, 0.f, 1.f };
+	if ( MODE == IlluminationMode::PHONG || MODE == IlluminationMode::BLINN )
+	{
+		wpos.x = wv1.pos.x * wf1 + wv2.pos.x * wf2 + wv3.pos.x * ( 1 - wf1 - wf2 );
+		wpos.y = wv1.pos.y * wf1 + wv2.pos.y * wf2 + wv3.pos.y * ( 1 - wf1 - wf2 );
+		wpos.z = wv1.pos.z * wf1 + wv2.pos.z * wf2 + wv3.pos.z * ( 1 - wf1 - wf2 );
+	}
+
+	float lit = 1.f;
+	if ( MODE != IlluminationMode::COLOR && MODE != IlluminationMode::DEFERRED && raster->light.shadow != NULL )
+	{
+		Vector sm = {
+			ts.shadow[0].x * wf1 + ts.shadow[1].x * wf2 + ts.shadow[2].x * ( 1 - wf1 - wf2 ),
+			ts.shadow[0].y * wf1 + ts.shadow[1].y * wf2 + ts.shadow[2].y * ( 1 - wf1 - wf2 ),
+			ts.shadow[0].z * wf1 + ts.shadow[1].z * wf2 + ts.shadow[2].z * ( 1 - wf1 - wf2 ), 1.f
+		};
+		lit = raster->light.shadow->lookup( sm );
+	}
+
+	Vertex pDraw = { lerpPoint, co, te, wnor };
+
+	if ( MODE == IlluminationMode::DIFFUSE )
+		pDraw.color = diffusePS( pDraw, wnor, lit );
+	else if ( MODE == IlluminationMode::PHONG )
+		pDraw.color = phonePS( pDraw, wnor, wpos, raster->camEye, lit );
+	else if ( MODE == IlluminationMode::BLINN )
+		pDraw.color = blinnPhonePS( pDraw, wnor, wpos, raster->camEye, lit );
+	if ( !plotPoint( pDraw ) ) return false;
+	if ( MODE == IlluminationMode::DEFERRED ) gbufferNormal[y * width + x] = PackNormal( wnor.x, wnor.y, wnor.z );
+	return true;
+}
+
+bool Device::checkCvv( const Vertex& pv )
+{
+	float w = pv.pos.w;
+	int check = 0;
+	if ( pv.pos.z < 0.0f ) check |= 1;
+	if ( pv.pos.z > w ) check |= 2;
+	if ( pv.pos.x < - w ) check |= 4;
+	if ( pv.pos.x > w ) check |= 8;
+	if ( pv.pos.y < - w ) check |= 16;
+	if ( pv.pos.y > w ) check |= 32;
+
+	return check != 0;
+}
+
+bool Device::triInterp_Barycentric( const Vector& v1, const Vector& v2, const Vector& v3, const Vector& p, float& u, float& v )
+{
+	float num, inv;
+
+	num = - ( p.x - v2.x ) * ( v3.y - v2.y ) + ( p.y - v2.y ) * ( v3.x - v2.x );
+	inv = - ( v1.x - v2.x ) * ( v3.y - v2.y ) + ( v1.y - v2.y ) * ( v3.x - v2.x );
+	u = num / inv;
+
+	num = - ( p.x - v3.x ) * ( v1.y - v3.y ) + ( p.y - v3.y ) * ( v1.x - v3.x );
+	inv = - ( v2.x - v3.x ) * ( v1.y - v3.y ) + ( v2.y - v3.y ) * ( v1.x - v3.x );
+	v = num / inv;
+
+	if( u + v > 1 )
+		return false;
+
+	return ( u >= 0 && u <= 1 ) && ( v >= 0 && v <= 1 );
+}
+
+static inline vfloat Interp( vfloat w1, vfloat w2, vfloat w3, float a1, float a2, float a3 )
+{
+	return w1 * vset1( a1 ) + w2 * vset1( a2 ) + w3 * vset1( a3 );
+}
+
+static inline void Normalize( vfloat& x, vfloat& y, vfloat& z )
+{
+	// the clamp keeps zero vectors at zero like VectorNormalize does
+	vfloat inv = vrsqrt( vmax( x * x + y * y + z * z, vset1( 1e-30f ) ) );
+	x = x * inv;
+	y = y * inv;
+	z = z * inv;
+}
+
+static inline vfloat PowShine( vfloat x )
+{
+	// x ^ PHONG_SHINE by repeated squaring instead of pow( ), x is in [0, 1]
+	vfloat r = vset1( 1.f );
+	for ( int e = PHONG_SHINE; e > 0; e >>= 1 )
+	{
+		if ( e & 1 ) r = r * x;
+		x = x * x;
+	}
+	return r;
+}
+
+template<IlluminationMode MODE, bool TEXTURED>
+int Device::shadeQuad( const TriangleSetup& ts, int x, int y, vfloat sf1, vfloat sf2, int mask, bool depthTest )
+{
+	PROFILE_SCOPE( PROFILE_SHADE );
+	PROFILE_COUNT( PROFILE_PIXELS_TESTED, MaskCount( mask ) );
+
+	// early depth test with the same rule as drawPoint2d, so occluded lanes are never lit
+	vfloat one = vset1( 1.f );
+	int p = y * width + x;
+	float depth[SIMD_WIDTH], zold[SIMD_WIDTH];
+	vstore( depth, roundDepth( Interp( sf1, sf2, one - sf1 - sf2, ts.z[0], ts.z[1], ts.z[2] ) ) );
+	if ( depthTest )
+	{
+		loadDepth( zold, p, mask );
+		mask &= vmovemask( vload( zold ) >= vload( depth ) );
+		if ( mask == 0 ) return 0;
+	}
+	PROFILE_COUNT( PROFILE_PIXELS_SHADED, MaskCount( mask ) );
+
+	uint32 colors[SIMD_WIDTH], normals[SIMD_WIDTH];
+	shadeColors<MODE, TEXTURED>( ts, sf1, sf2, mask, colors, normals );
+
+	PROFILE_SCOPE( PROFILE_OUTPUT );
+	uint32* crow = framebuffer[y] + x;
+	uint32* nrow = gbufferNormal + p;
+	for ( int l = 0; l < SIMD_WIDTH; l ++ )
+	{
+		if ( !( ( mask >> l ) & 1 ) ) continue;
+		PROFILE_COUNT( PROFILE_OVERDRAW, depthAt( p + l ) != clearDepth );
+		crow[l] = colors[l];
+		if ( MODE == IlluminationMode::DEFERRED ) nrow[l] = normals[l];
+	}
+	storeDepth( p, depth, mask );
+	return mask;
+}
+
+// lighting of shadeQuad for the lanes in mask, packed into colors, and the packed g-buffer normals of a
+// DEFERRED triangle; nothing is read from or written to the frame buffers
+template<IlluminationMode MODE, bool TEXTURED>
+void Device::shadeColors( const TriangleSetup& ts, vfloat sf1, vfloat sf2, int mask, uint32* colors, uint32* normals )
+{
+	const Vertex& wv1 = ts.v[0];
+	const Vertex& wv2 = ts.v[1];
+	const Vertex& wv3 = ts.v[2];
+
+	vfloat one = vset1( 1.f ), zero = vset1( 0.f );
+	vfloat p1 = sf1 * vset1( ts.rhw[0] ), p2 = sf2 * vset1( ts.rhw[1] ), p3 = ( one - sf1 - sf2 ) * vset1( ts.rhw[2] );
+	vfloat inv = one / ( p1 + p2 + p3 );
+	vfloat wf1 = p1 * inv, wf2 = p2 * inv, wf3 = one - wf1 - wf2;
+
+	vfloat cr = Interp( wf1, wf2, wf3, wv1.color.r, wv2.color.r, wv3.color.r );
+	vfloat cg = Interp( wf1, wf2, wf3, wv1.color.g, wv2.color.g, wv3.color.g );
+	vfloat cb = Interp( wf1, wf2, wf3, wv1.color.b, wv2.color.b, wv3.color.b );
+
+	if ( TEXTURED )
+	{
+		// texels are gathered lane by lane, with one mip level for the quad taken at its first covered pixel
+		float s1[SIMD_WIDTH], s2[SIMD_WIDTH], tu[SIMD_WIDTH], tv[SIMD_WIDTH];
+		vstore( s1, sf1 );
+		vstore( s2, sf2 );
+		vstore( tu, Interp( wf1, wf2, wf3, wv1.tex.u, wv2.tex.u, wv3.tex.u ) );
+		vstore( tv, Interp( wf1, wf2, wf3, wv1.tex.v, wv2.tex.v, wv3.tex.v ) );
+
+		int first = 0;
+		while ( !( ( mask >> first ) & 1 ) ) first ++;
+		float lod = TextureLod( raster->texture, ts, s1[first], s2[first] );
+
+		float tr[SIMD_WIDTH], tg[SIMD_WIDTH], tb[SIMD_WIDTH];
+		for ( int l = 0; l < SIMD_WIDTH; l ++ )
+		{
+			Color c = ( mask >> l ) & 1 ? raster->texture->sample( tu[l], tv[l], lod, raster->textureFilter ) : Color { 0.f, 0.f, 0.f };
+			tr[l] = c.r;
+			tg[l] = c.g;
+			tb[l] = c.b;
+		}
+		cr = cr * vload( tr );
+		cg = cg * vload( tg );
+		cb = cb * vload( tb );
+	}
+
+	vfloat nx = zero, ny = zero, nz = zero;
+	if ( MODE != IlluminationMode::COLOR )
+	{
+		nx = Interp( wf1, wf2, wf3, wv1.normal.x, wv2.normal.x, wv3.normal.x );
+		ny = Interp( wf1, wf2, wf3, wv1.normal.y, wv2.normal.y, wv3.normal.y );
+		nz = Interp( wf1, wf2, wf3, wv1.normal.z, wv2.normal.z, wv3.normal.z );
+		Normalize( nx, ny, nz );
+	}
+
+	// the deferred variant stops at albedo and normal, lightTile( ) does the rest
+	if ( MODE != IlluminationMode::COLOR && MODE != IlluminationMode::DEFERRED )
+	{
+		vfloat lx = vset1( raster->light.direction.x ), ly = vset1( raster->light.direction.y ), lz = vset1( raster->light.direction.z );
+		vfloat ndotl = vmax( zero, zero - ( lx * nx + ly * ny + lz * nz ) );
+
+		vfloat kd, spec = zero;
+		if ( MODE == IlluminationMode::DIFFUSE )
+		{
+			kd = vset1( DIFFUSE_KD ) * ndotl;
+		}
+		else
+		{
+			kd = vset1( PHONG_KD ) * ndotl;
+
+			vfloat vx = vset1( raster->camEye.x ) - Interp( wf1, wf2, wf3, wv1.pos.x, wv2.pos.x, wv3.pos.x );
+			vfloat vy = vset1( raster->camEye.y ) - Interp( wf1, wf2, wf3, wv1.pos.y, wv2.pos.y, wv3.pos.y );
+			vfloat vz = vset1( raster->camEye.z ) - Interp( wf1, wf2, wf3, wv1.pos.z, wv2.pos.z, wv3.pos.z );
+			Normalize( vx, vy, vz );
+
+			vfloat cosine;
+			if ( MODE == IlluminationMode::PHONG )
+			{
+				vfloat ldotn2 = vset1( 2.f ) * ( lx * nx + ly * ny + lz * nz );
+				vfloat rx = lx - nx * ldotn2, ry = ly - ny * ldotn2, rz = lz - nz * ldotn2;
+				Normalize( rx, ry, rz );
+				cosine = rx * vx + ry * vy + rz * vz;
+			}
+			else
+			{
+				vfloat hx = vx - lx, hy = vy - ly, hz = vz - lz;
+				Normalize( hx, hy, hz );
+				cosine = hx * nx + hy * ny + hz * nz;
+			}
+			spec = PowShine( vmax( zero, cosine ) ) * vset1( PHONG_KS );
+		}
+
+		// the shadow map is gathered lane by lane like the texture
+		vfloat term = kd + spec;
+		if ( raster->light.shadow != NULL )
+		{
+			float sx[SIMD_WIDTH], sy[SIMD_WIDTH], sz[SIMD_WIDTH], lit[SIMD_WIDTH];
+			vstore( sx, Interp( wf1, wf2, wf3, ts.shadow[0].x, ts.shadow[1].x, ts.shadow[2].x ) );
+			vstore( sy, Interp( wf1, wf2, wf3, ts.shadow[0].y, ts.shadow[1].y, ts.shadow[2].y ) );
+			vstore( sz, Interp( wf1, wf2, wf3, ts.shadow[0].z, ts.shadow[1].z, ts.shadow[2].z ) );
+			for ( int l = 0; l < SIMD_WIDTH; l ++ )
+			{
+				lit[l] = ( mask >> l ) & 1 ? raster->light.shadow->lookup( { sx[l], sy[l], sz[l], 1.f } ) : 0.f;
+			}
+			term = term * vload( lit );
+		}
+
+		cr = cr * ( vset1( raster->light.color.r ) * term );
+		cg = cg * ( vset1( raster->light.color.g ) * term );
+		cb = cb * ( vset1( raster->light.color.b ) * term );
+	}
+
+	float r[SIMD_WIDTH], g[SIMD_WIDTH], b[SIMD_WIDTH];
+	vstore( r, vmin( cr, one ) * vset1( 255.f ) );
+	vstore( g, vmin( cg, one ) * vset1( 255.f ) );
+	vstore( b, vmin( cb, one ) * vset1( 255.f ) );
+
+	float gx[SIMD_WIDTH], gy[SIMD_WIDTH], gz[SIMD_WIDTH];
+	if ( MODE == IlluminationMode::DEFERRED )
+	{
+		vstore( gx, nx );
+		vstore( gy, ny );
+		vstore( gz, nz );
+	}
+
+	for ( int l = 0; l < SIMD_WIDTH; l ++ )
+	{
+		if ( !( ( mask >> l ) & 1 ) ) continue;
+		colors[l] = ( ( int )r[l] << 16 ) | ( ( int )g[l] << 8 ) | ( int )b[l];
+		if ( MODE == IlluminationMode::DEFERRED ) normals[l] = PackNormal( gx[l], gy[l], gz[l] );
+	}
+}
+
+// rasterTriangle with SAMPLES coverage and depth samples per pixel: a pixel with any sample passing is shaded
+// once, and its color goes to just those samples. a pixel all of whose samples pass keeps a single color
+template<IlluminationMode MODE, bool TEXTURED, int SAMPLES>
+int Device::rasterMultisample( const TriangleSetup& ts, int x0, int y0, int x1, int y1 )
+{
+	std::vector<uint32>& store = sampleColors[( y0 / RASTER_TILE ) * tilesX + x0 / RASTER_TILE];
+
+	x0 = std::max( x0, ts.minX );
+	y0 = std::max( y0, ts.minY );
+	x1 = std::min( x1, ts.maxX );
+	y1 = std::min( y1, ts.maxY );
+
+	// edge values, weights and depth move by constant offsets from the pixel sample point to every sample,
+	// depth being affine in screen space
+	const int ( *positions )[2] = SAMPLES == 4 ? SAMPLE_POSITIONS_4X : SAMPLE_POSITIONS_8X;
+	float dzdx = ts.a[0] * ts.z[0] + ts.a[1] * ts.z[1] + ts.a[2] * ts.z[2];
+	float dzdy = ts.b[0] * ts.z[0] + ts.b[1] * ts.z[1] + ts.b[2] * ts.z[2];
+	long long eo[3][SAMPLES], eoMin[3] = { 0, 0, 0 }, eoMax[3] = { 0, 0, 0 };
+	float fx[SAMPLES], fy[SAMPLES], zo[SAMPLES];
+	for ( int s = 0; s < SAMPLES; s ++ )
+	{
+		int ox = positions[s][0] * ( 1 << ( SUBPIXEL_BITS - 4 ) ), oy = positions[s][1] * ( 1 << ( SUBPIXEL_BITS - 4 ) );
+		for ( int k = 0; k < 3; k ++ )
+		{
+			eo[k][s] = ( long long )ts.ea[k] * ox + ( long long )ts.eb[k] * oy;
+			eoMin[k] = s == 0 ? eo[k][s] : std::min( eoMin[k], eo[k][s] );
+			eoMax[k] = s == 0 ? eo[k][s] : std::max( eoMax[k], eo[k][s] );
+		}
+		fx[s] = positions[s][0] / 16.f;
+		fy[s] = positions[s][1] / 16.f;
+		zo[s] = dzdx * fx[s] + dzdy * fy[s];
+	}
+
+	int written = 0;
+	vfloat one = vset1( 1.f );
+	const int all = ( 1 << SAMPLES ) - 1;
+	float cleared[SAMPLES];
+	std::fill( cleared, cleared + SAMPLES, clearDepth );
+
+	for ( int by = y0 & ~( RASTER_BLOCK - 1 ); by <= y1; by += RASTER_BLOCK )
+	{
+		int sy = std::max( by, y0 ), ey = std::min( by + RASTER_BLOCK - 1, y1 );
+		for ( int bx = x0 & ~( RASTER_BLOCK - 1 ); bx <= x1; bx += RASTER_BLOCK )
+		{
+			int sx = std::max( bx, x0 ), ex = std::min( bx + RASTER_BLOCK - 1, x1 );
+
+			// zbuffer holds the farthest sample of every pixel, so only the rejection half of the hierarchical z
+			// applies; inside means every sample of the block is covered
+			int block = ( by / RASTER_BLOCK ) * blocksX + bx / RASTER_BLOCK;
+			if ( ts.zMin > hizBlockMax[block] ) continue;
+			int blockWritten = 0;
+
+			bool inside;
+			if ( !EdgeTestRect( ts, bx, by, RASTER_BLOCK, inside, SAMPLE_MARGIN ) ) continue;
+
+			long long step1 = ( long long )ts.ea[0] * ( 1 << SUBPIXEL_BITS );
+			long long step2 = ( long long )ts.ea[1] * ( 1 << SUBPIXEL_BITS );
+			long long step3 = ( long long )ts.ea[2] * ( 1 << SUBPIXEL_BITS );
+			for ( int j = sy; j <= ey; j ++ )
+			{
+				float sf1 = ts.a[0] * bx + ts.b[0] * j + ts.c[0];
+				float sf2 = ts.a[1] * bx + ts.b[1] * j + ts.c[1];
+				long long e1 = EdgeAt( ts, 0, bx, j ), e2 = EdgeAt( ts, 1, bx, j ), e3 = EdgeAt( ts, 2, bx, j );
+
+				for ( int gx = bx; gx <= ex; gx += SIMD_WIDTH )
+				{
+					vfloat offset = vramp( ) + vset1( ( float )( gx - bx ) );
+					vfloat w1 = vset1( sf1 ) + vset1( ts.a[0] ) * offset;
+					vfloat w2 = vset1( sf2 ) + vset1( ts.a[1] ) * offset;
+					float s1[SIMD_WIDTH], s2[SIMD_WIDTH], depth[SIMD_WIDTH];
+					vstore( s1, w1 );
+					vstore( s2, w2 );
+					vstore( depth, Interp( w1, w2, one - w1 - w2, ts.z[0], ts.z[1], ts.z[2] ) );
+
+					int mask = 0, passed[SIMD_WIDTH];
+					for ( int l = 0; l < SIMD_WIDTH; l ++, e1 += step1, e2 += step2, e3 += step3 )
+					{
+						int i = gx + l;
+						passed[l] = 0;
+						if ( i < sx || i > ex ) continue;
+
+						// only pixels an edge runs through test their samples one by one
+						int covered = all;
+						if ( !inside && ( ( e1 + eoMin[0] ) | ( e2 + eoMin[1] ) | ( e3 + eoMin[2] ) ) < 0 )
+						{
+							if ( e1 + eoMax[0] < 0 || e2 + eoMax[1] < 0 || e3 + eoMax[2] < 0 ) continue;
+							covered = 0;
+							for ( int s = 0; s < SAMPLES; s ++ )
+							{
+								if ( ( ( e1 + eo[0][s] ) | ( e2 + eo[1][s] ) | ( e3 + eo[2][s] ) ) >= 0 ) covered |= 1 << s;
+							}
+							if ( covered == 0 ) continue;
+						}
+						PROFILE_COUNT( PROFILE_PIXELS_TESTED, 1 );
+
+						int p = j * width + i;
+						const float* zs = sampleSlot[p] & SAMPLE_WRITTEN ? sampleDepth + ( size_t )p * SAMPLES : cleared;
+						for ( int s = 0; s < SAMPLES; s ++ )
+						{
+							if ( ( ( covered >> s ) & 1 ) && !( zs[s] < roundDepth( depth[l] + zo[s] ) ) ) passed[l] |= 1 << s;
+						}
+						if ( passed[l] == 0 ) continue;
+						mask |= 1 << l;
+
+						// a pixel whose sample point the triangle misses is shaded at its first covered sample instead,
+						// so the attributes are never extrapolated past the edges
+						if ( covered != all && ( e1 | e2 | e3 ) < 0 )
+						{
+							int s = 0;
+							while ( !( ( covered >> s ) & 1 ) ) s ++;
+							s1[l] += ts.a[0] * fx[s] + ts.b[0] * fy[s];
+							s2[l] += ts.a[1] * fx[s] + ts.b[1] * fy[s];
+						}
+					}
+					if ( mask == 0 ) continue;
+					PROFILE_COUNT( PROFILE_PIXELS_SHADED, MaskCount( mask ) );
+
+					uint32 colors[SIMD_WIDTH];
+					{
+						PROFILE_SCOPE( PROFILE_SHADE );
+						shadeColors<MODE, TEXTURED>( ts, vload( s1 ), vload( s2 ), mask, colors, NULL );
+					}
+
+					PROFILE_SCOPE( PROFILE_OUTPUT );
+					for ( int l = 0; l < SIMD_WIDTH; l ++ )
+					{
+						if ( !( ( mask >> l ) & 1 ) ) continue;
+						int i = gx + l, p = j * width + i;
+						unsigned short& slot = sampleSlot[p];
+						PROFILE_COUNT( PROFILE_OVERDRAW, depthAt( p ) != clearDepth );
+						if ( passed[l] == all )
+						{
+							framebuffer[j][i] = colors[l];
+							slot &= ~SAMPLE_EXPANDED;
+						}
+						else
+						{
+							// an edge pixel starts out with its single color in every sample
+							if ( !( slot & SAMPLE_EXPANDED ) )
+							{
+								if ( ( slot & SAMPLE_INDEX ) == 0 )
+								{
+									store.resize( store.size( ) + SAMPLES );
+									slot |= ( unsigned short )( store.size( ) / SAMPLES );
+								}
+								uint32* sc = &store[( ( slot & SAMPLE_INDEX ) - 1 ) * SAMPLES];
+								std::fill( sc, sc + SAMPLES, framebuffer[j][i] );
+								slot |= SAMPLE_EXPANDED;
+							}
+							uint32* sc = &store[( ( slot & SAMPLE_INDEX ) - 1 ) * SAMPLES];
+							for ( int s = 0; s < SAMPLES; s ++ )
+							{
+								if ( ( passed[l] >> s ) & 1 ) sc[s] = colors[l];
+							}
+						}
+
+						float* zs = sampleDepth + ( size_t )p * SAMPLES;
+						if ( !( slot & SAMPLE_WRITTEN ) )
+						{
+							std::fill( zs, zs + SAMPLES, clearDepth );
+							slot |= SAMPLE_WRITTEN;
+						}
+						float zmax = -1e30f;
+						for ( int s = 0; s < SAMPLES; s ++ )
+						{
+							if ( ( passed[l] >> s ) & 1 ) zs[s] = roundDepth( depth[l] + zo[s] );
+							zmax = std::max( zmax, zs[s] );
+						}
+						setDepth( p, zmax );
+						blockWritten ++;
+					}
+				}
+			}
+
+			if ( blockWritten )
+			{
+				updateHiZ( block );
+				written += blockWritten;
+			}
+		}
+	}
+
+	return written;
+}
+
+// coverage and depth of rasterTriangle without anything else: depth is computed with the very same operations
+// as shadeQuad ( SIMD ) or shadePixel, so a z prepass leaves exactly the depths the shading pass compares against
+template<bool SIMD>
+int Device::rasterDepth( const TriangleSetup& ts, int x0, int y0, int x1, int y1 )
+{
+	x0 = std::max( x0, ts.minX );
+	y0 = std::max( y0, ts.minY );
+	x1 = std::min( x1, ts.maxX );
+	y1 = std::min( y1, ts.maxY );
+
+	int written = 0;
+	vfloat one = vset1( 1.f );
+
+	for ( int by = y0 & ~( RASTER_BLOCK - 1 ); by <= y1; by += RASTER_BLOCK )
+	{
+		int sy = std::max( by, y0 ), ey = std::min( by + RASTER_BLOCK - 1, y1 );
+		for ( int bx = x0 & ~( RASTER_BLOCK - 1 ); bx <= x1; bx += RASTER_BLOCK )
+		{
+			int sx = std::max( bx, x0 ), ex = std::min( bx + RASTER_BLOCK - 1, x1 );
+
+			int block = ( by / RASTER_BLOCK ) * blocksX + bx / RASTER_BLOCK;
+			if ( ts.zMin > hizBlockMax[block] ) continue;
+			bool depthTest = ts.zMax > hizBlockMin[block];
+			int blockWritten = 0;
+
+			bool inside;
+			if ( !EdgeTestRect( ts, bx, by, RASTER_BLOCK, inside ) ) continue;
+
+			long long step1 = ( long long )ts.ea[0] * ( 1 << SUBPIXEL_BITS );
+			long long step2 = ( long long )ts.ea[1] * ( 1 << SUBPIXEL_BITS );
+			long long step3 = ( long long )ts.ea[2] * ( 1 << SUBPIXEL_BITS );
+			for ( int j = sy; j <= ey; j ++ )
+			{
+				float sf1 = ts.a[0] * bx + ts.b[0] * j + ts.c[0];
+				float sf2 = ts.a[1] * bx + ts.b[1] * j + ts.c[1];
+				long long e1 = EdgeAt( ts, 0, bx, j ), e2 = EdgeAt( ts, 1, bx, j ), e3 = EdgeAt( ts, 2, bx, j );
+
+				if ( SIMD )
+				{
+					for ( int gx = bx; gx <= ex; gx += SIMD_WIDTH )
+					{
+						int mask = 0;
+						for ( int l = 0; l < SIMD_WIDTH; l ++, e1 += step1, e2 += step2, e3 += step3 )
+						{
+							int i = gx + l;
+							if ( i >= sx && i <= ex && ( inside || ( ( e1 | e2 | e3 ) >= 0 ) ) ) mask |= 1 << l;
+						}
+						if ( mask == 0 ) continue;
+
+						vfloat offset = vramp( ) + vset1( ( float )( gx - bx ) );
+						vfloat w1 = vset1( sf1 ) + vset1( ts.a[0] ) * offset;
+						vfloat w2 = vset1( sf2 ) + vset1( ts.a[1] ) * offset;
+
+						float depth[SIMD_WIDTH], zold[SIMD_WIDTH];
+						vstore( depth, roundDepth( Interp( w1, w2, one - w1 - w2, ts.z[0], ts.z[1], ts.z[2] ) ) );
+						PROFILE_COUNT( PROFILE_PIXELS_TESTED, MaskCount( mask ) );
+						if ( depthTest )
+						{
+							loadDepth( zold, j * width + gx, mask );
+							mask &= vmovemask( vload( zold ) >= vload( depth ) );
+							if ( mask == 0 ) continue;
+						}
+						storeDepth( j * width + gx, depth, mask );
+						blockWritten += MaskCount( mask );
+					}
+					continue;
+				}
+
+				for ( int i = bx; i <= ex; i ++ )
+				{
+					if ( i >= sx && ( inside || ( ( e1 | e2 | e3 ) >= 0 ) ) )
+					{
+						float z = roundDepth( ts.z[0] * sf1 + ts.z[1] * sf2 + ts.z[2] * ( 1 - sf1 - sf2 ) );
+						PROFILE_COUNT( PROFILE_PIXELS_TESTED, 1 );
+						if ( !( depthAt( j * width + i ) < z ) )
+						{
+							setDepth( j * width + i, z );
+							blockWritten ++;
+						}
+					}
+					sf1 += ts.a[0];
+					sf2 += ts.a[1];
+					e1 += step1;
+					e2 += step2;
+					e3 += step3;
+				}
+			}
+
+			if ( blockWritten )
+			{
+				updateHiZ( block );
+				written += blockWritten;
+			}
+		}
+	}
+
+	return written;
+}
+
+// deferred lighting of one raster tile in LIGHT_TILE squares, each of which only keeps the point lights whose
+// sphere reaches the part of the view volume spanned by its pixels and their depth range
+void Device::lightTile( int tile )
+{
+	// a tile nothing was drawn to is still logically cleared
+	if ( tileCleared[tile] ) return;
+
+	PROFILE_SCOPE( PROFILE_LIGHT );
+
+	const Batch& batch = *raster;
+	const float( *vp )[4] = batch.viewProjection.m;
+	const float( *ivp )[4] = batch.inverseViewProjection.m;
+	int x0 = ( tile % tilesX ) * RASTER_TILE;
+	int y0 = ( tile / tilesX ) * RASTER_TILE;
+	int x1 = std::min( x0 + RASTER_TILE, width );
+	int y1 = std::min( y0 + RASTER_TILE, height );
+
+	std::vector<int> visible;
+	visible.reserve( batch.pointLights.size( ) );
+	vfloat one = vset1( 1.f ), zero = vset1( 0.f );
+
+	// depth keys back to projected depths, exactly for the float formats
+	float toDepth = 1.f / depthScale;
+
+	for ( int ty = y0; ty < y1; ty += LIGHT_TILE )
+	{
+		for ( int tx = x0; tx < x1; tx += LIGHT_TILE )
+		{
+			int ex = std::min( tx + LIGHT_TILE, x1 ), ey = std::min( ty + LIGHT_TILE, y1 );
+
+			float zmin = 1e30f, zmax = -1e30f;
+			bool any = false;
+			for ( int y = ty; y < ey; y ++ )
+			{
+				for ( int x = tx; x < ex; x ++ )
+				{
+					if ( ( gbufferNormal[y * width + x] & GBUFFER_WRITTEN ) != GBUFFER_WRITTEN ) continue;
+					float z = depthAt( y * width + x ) * toDepth;
+					zmin = std::min( zmin, z );
+					zmax = std::max( zmax, z );
+					any = true;
+				}
+			}
+			if ( !any ) continue;
+
+			// world space planes through the outermost sample points and the depth range, inside where
+			// x * p.x + y * p.y + z * p.z + p.w >= 0; ndc x >= a is clip.x - a * clip.w >= 0, and a clip
+			// coordinate is a column of the view-projection matrix
+			const int axis[6] = { 0, 0, 1, 1, 2, 2 };
+			const float sign[6] = { 1.f, -1.f, 1.f, -1.f, 1.f, -1.f };
+			const float bound[6] = {
+				2.f * tx / width - 1.f, 2.f * ( ex - 1 ) / width - 1.f,
+				1.f - 2.f * ( ey - 1 ) / height, 1.f - 2.f * ty / height,
+				zmin, zmax
+			};
+			Vector planes[6];
+			for ( int i = 0; i < 6; i ++ )
+			{
+				int a = axis[i];
+				float s = sign[i], v = bound[i];
+				Vector p = { s * ( vp[0][a] - v * vp[0][3] ), s * ( vp[1][a] - v * vp[1][3] ), s * ( vp[2][a] - v * vp[2][3] ),
+					s * ( vp[3][a] - v * vp[3][3] ) };
+				float len = sqrtf( p.x * p.x + p.y * p.y + p.z * p.z );
+				if ( len > 0.f ) p /= len;
+				planes[i] = p;
+			}
+
+			visible.clear( );
+			for ( int i = 0; i < ( int )batch.pointLights.size( ); i ++ )
+			{
+				const PointLight& pl = batch.pointLights[i];
+				bool outside = false;
+				for ( int k = 0; k < 6 && !outside; k ++ )
+				{
+					const Vector& p = planes[k];
+					outside = p.x * pl.position.x + p.y * pl.position.y + p.z * pl.position.z + p.w < - pl.radius;
+				}
+				if ( !outside ) visible.push_back( i );
+			}
+			PROFILE_COUNT( PROFILE_LIGHTS_SHADED, ( int )visible.size( ) );
+
+			for ( int y = ty; y < ey; y ++ )
+			{
+				uint32* nrow = gbufferNormal + y * width;
+				uint32* crow = framebuffer[y];
+				float fy = 1.f - 2.f * y / height;
+
+				for ( int gx = tx; gx < ex; gx += SIMD_WIDTH )
+				{
+					// the flags are consumed here, so the next frame starts with a clean g-buffer
+					int mask = 0;
+					float z[SIMD_WIDTH], nx[SIMD_WIDTH], ny[SIMD_WIDTH], nz[SIMD_WIDTH], ar[SIMD_WIDTH], ag[SIMD_WIDTH], ab[SIMD_WIDTH];
+					for ( int l = 0; l < SIMD_WIDTH; l ++ )
+					{
+						int x = gx + l;
+						z[l] = nx[l] = ny[l] = nz[l] = ar[l] = ag[l] = ab[l] = 0.f;
+						if ( x >= ex || ( nrow[x] & GBUFFER_WRITTEN ) != GBUFFER_WRITTEN ) continue;
+
+						mask |= 1 << l;
+						z[l] = depthAt( y * width + x ) * toDepth;
+						UnpackNormal( nrow[x], nx[l], ny[l], nz[l] );
+						nrow[x] = 0;
+						ar[l] = ( ( crow[x] >> 16 ) & 0xff ) * ( 1.f / 255.f );
+						ag[l] = ( ( crow[x] >> 8 ) & 0xff ) * ( 1.f / 255.f );
+						ab[l] = ( crow[x] & 0xff ) * ( 1.f / 255.f );
+					}
+					if ( mask == 0 ) continue;
+
+					// world position back from the screen position and depth through the inverse view-projection
+					vfloat sx = ( vramp( ) + vset1( ( float )gx ) ) * vset1( 2.f / width ) - one;
+					vfloat sy = vset1( fy ), sz = vload( z );
+					vfloat pw = sx * vset1( ivp[0][3] ) + sy * vset1( ivp[1][3] ) + sz * vset1( ivp[2][3] ) + vset1( ivp[3][3] );
+					vfloat rw = one / pw;
+					vfloat px = ( sx * vset1( ivp[0][0] ) + sy * vset1( ivp[1][0] ) + sz * vset1( ivp[2][0] ) + vset1( ivp[3][0] ) ) * rw;
+					vfloat py = ( sx * vset1( ivp[0][1] ) + sy * vset1( ivp[1][1] ) + sz * vset1( ivp[2][1] ) + vset1( ivp[3][1] ) ) * rw;
+					vfloat pz = ( sx * vset1( ivp[0][2] ) + sy * vset1( ivp[1][2] ) + sz * vset1( ivp[2][2] ) + vset1( ivp[3][2] ) ) * rw;
+
+					vfloat vx = vset1( batch.camEye.x ) - px, vy = vset1( batch.camEye.y ) - py, vz = vset1( batch.camEye.z ) - pz;
+					Normalize( vx, vy, vz );
+					vfloat wx = vload( nx ), wy = vload( ny ), wz = vload( nz );
+					Normalize( wx, wy, wz );
+
+					// same diffuse and specular terms as BLINN, with every light's contribution summed
+					vfloat cr = zero, cg = zero, cb = zero;
+					for ( size_t i = 0; i < batch.lights.size( ); i ++ )
+					{
+						const Light& dl = batch.lights[i];
+						vfloat lx = vset1( - dl.direction.x ), ly = vset1( - dl.direction.y ), lz = vset1( - dl.direction.z );
+						vfloat hx = vx + lx, hy = vy + ly, hz = vz + lz;
+						Normalize( hx, hy, hz );
+						vfloat term = vset1( PHONG_KD ) * vmax( zero, lx * wx + ly * wy + lz * wz ) +
+							PowShine( vmax( zero, hx * wx + hy * wy + hz * wz ) ) * vset1( PHONG_KS );
+						if ( dl.shadow != NULL )
+						{
+							float wpx[SIMD_WIDTH], wpy[SIMD_WIDTH], wpz[SIMD_WIDTH], lit[SIMD_WIDTH];
+							vstore( wpx, px );
+							vstore( wpy, py );
+							vstore( wpz, pz );
+							for ( int l = 0; l < SIMD_WIDTH; l ++ )
+							{
+								Vector sm;
+								dl.shadow->project( sm, { wpx[l], wpy[l], wpz[l], 1.f } );
+								lit[l] = ( mask >> l ) & 1 ? dl.shadow->lookup( sm ) : 0.f;
+							}
+							term = term * vload( lit );
+						}
+						cr = cr + vset1( dl.color.r ) * term;
+						cg = cg + vset1( dl.color.g ) * term;
+						cb = cb + vset1( dl.color.b ) * term;
+					}
+					for ( size_t i = 0; i < visible.size( ); i ++ )
+					{
+						const PointLight& pl = batch.pointLights[visible[i]];
+						vfloat lx = vset1( pl.position.x ) - px, ly = vset1( pl.position.y ) - py, lz = vset1( pl.position.z ) - pz;
+						vfloat falloff = vmax( zero, one - ( lx * lx + ly * ly + lz * lz ) * vset1( 1.f / ( pl.radius * pl.radius ) ) );
+						Normalize( lx, ly, lz );
+						vfloat hx = vx + lx, hy = vy + ly, hz = vz + lz;
+						Normalize( hx, hy, hz );
+						vfloat term = ( vset1( PHONG_KD ) * vmax( zero, lx * wx + ly * wy + lz * wz ) +
+							PowShine( vmax( zero, hx * wx + hy * wy + hz * wz ) ) * vset1( PHONG_KS ) ) * falloff * falloff;
+						cr = cr + vset1( pl.color.r ) * term;
+						cg = cg + vset1( pl.color.g ) * term;
+						cb = cb + vset1( pl.color.b ) * term;
+					}
+
+					float r[SIMD_WIDTH], g[SIMD_WIDTH], b[SIMD_WIDTH];
+					vstore( r, vmin( vload( ar ) * cr, one ) * vset1( 255.f ) );
+					vstore( g, vmin( vload( ag ) * cg, one ) * vset1( 255.f ) );
+					vstore( b, vmin( vload( ab ) * cb, one ) * vset1( 255.f ) );
+					for ( int l = 0; l < SIMD_WIDTH; l ++ )
+					{
+						if ( !( ( mask >> l ) & 1 ) ) continue;
+						crow[gx + l] = ( ( int )r[l] << 16 ) | ( ( int )g[l] << 8 ) | ( int )b[l];
+					}
+				}
+			}
+		}
+	}
 }
 
-Color Device::diffusePS( const Vertex& sv, const Vector& normal )
+Color Device::diffusePS( const Vertex& sv, const Vector& normal, float lit )
 {
-	float kd = 0.5f;
+	float kd = DIFFUSE_KD;
 
-	Vector lightDir = light->direction;
-	Color lightColor = light->color;
+	Vector lightDir = raster->light.direction;
+	Color lightColor = raster->light.color * lit;
 	Color diffuse = lightColor * kd * std::max( 0.f, lightDir * -1.f * normal );
 
 	return diffuse * sv.color;
 }
 
-Color Device::phonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye )
+Color Device::phonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye, float lit )
 {
-	float ks = 1.5f, kd = 1.0f;
-	float shine = 20;
+	float ks = PHONG_KS, kd = PHONG_KD;
+	float shine = ( float )PHONG_SHINE;
 
-	Vector lightDir = light->direction;
-	Color lightColor = light->color;
+	Vector lightDir = raster->light.direction;
+	Color lightColor = raster->light.color * lit;
 	Color diffuse = lightColor * kd * std::max( 0.f, lightDir * -1.f * normal );
 
 	Vector reflect;
@@ -425,13 +2443,13 @@ Color Device::phonePS( const Vertex& sv, const Vector& normal, const Vector& pos
 	return ( specular + diffuse ) * sv.color;
 }
 
-Color Device::blinnPhonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye )
+Color Device::blinnPhonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye, float lit )
 {
-	float ks = 1.5f, kd = 1.0f;
-	float shine = 20;
+	float ks = PHONG_KS, kd = PHONG_KD;
+	float shine = ( float )PHONG_SHINE;
 
-	Vector lightDir = light->direction;
-	Color lightColor = light->color;
+	Vector lightDir = raster->light.direction;
+	Color lightColor = raster->light.color * lit;
 	Color diffuse = lightColor * kd * std::max( 0.f, lightDir * -1.f * normal );
 
 	Vector view = camEye - pos;
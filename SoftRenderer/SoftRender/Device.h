@@ -1,47 +1,358 @@
 #pragma once
 
 #include "Config.h"
-#include <Windows.h>
 #include "math.h"
+#include "Vertex.h"
+#include "SimdFloat.h"
+#include "Texture.h"
+#include "Light.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <vector>
 
 class Transform;
+class ThreadPool;
+class JobQueue;
 struct Vertex;
+struct PackedMesh;
 struct Color;
 struct Texcoord;
-struct Light;
 
-enum class IlluminationMode{ COLOR, DIFFUSE, PHONG, BLINN };
+// DEFERRED rasterizes albedo, normal and depth only and lights every visible pixel once at present( ), with
+// the init( ) light and everything given to setLights( ) under the BLINN model
+enum class IlluminationMode{ COLOR, DIFFUSE, PHONG, BLINN, DEFERRED };
+
+// depth buffer formats. FLOAT32_REVERSED goes with a projection mapping the near plane to 1 and the far plane
+// to 0 ( Transform::setDepthRange ), so the float precision gathered around 0 goes to the far distance;
+// UNORM24 and UNORM16 round depth to that many bits, UNORM16 in half the memory of the others
+enum class DepthFormat{ FLOAT32, FLOAT32_REVERSED, UNORM24, UNORM16 };
+
+// output of the vertex stage, computed once per vertex and shared by every triangle indexing it
+struct TransformedVertex
+{
+	Vector	clip;
+	Vector	screen;		// only valid when the vertex is in front of the near plane
+	int		clipCode;	// one bit per clip space plane the vertex is outside of
+	bool	culled;
+};
+
+// per-triangle constants computed once in triangle setup and reused for every covered pixel
+struct TriangleSetup
+{
+	Vertex	v[3];
+	float	z[3];
+	float	rhw[3];
+	float	zMin, zMax;
+	float	a[3], b[3], c[3];	// barycentric weight of vertex k at pixel ( x, y ) is a[k] * x + b[k] * y + c[k]
+	int		minX, minY, maxX, maxY;
+
+	// exact coverage from the vertices snapped to 16.8 fixed point: pixel ( x, y ) is covered when
+	// ea[k] * ( x << 8 ) + eb[k] * ( y << 8 ) + ec[k] >= 0 for every k, the top-left bias is folded into ec
+	int			ea[3], eb[3];
+	long long	ec[3];
+
+	int			planes;		// offset of the varying plane equations of a drawShaded triangle, see Shader.h
+
+	Vector		shadow[3];	// ShadowMap::project( ) of every vertex when the light casts shadows
+};
 
 class Device
 {
 public:
+	// rasterizes a triangle into one tile and returns the number of pixels it wrote
+	typedef int ( Device::*RasterFunc )( const TriangleSetup& ts, int x0, int y0, int x1, int y1 );
+	// shades the covered lanes of SIMD_WIDTH pixels starting at ( x, y ) into colors, see Shader.h
+	typedef void ( *ShadeGroupFunc )( const void* shader, const float* planes, int x, int y, int mask, uint32* colors );
+
+	static const int MAX_VARYINGS = 32;
+	static const int MAX_PIPELINE_DEPTH = 3;
+
+	// one flush( ) worth of binned triangles with the draw state they are shaded with, captured when it is
+	// flushed, so the raster side never reads state the caller may already have changed for the next one
+	struct Batch
+	{
+		inline Batch( ) : rasterFunc( NULL ), texture( NULL ), textureFilter( TextureFilter::TRILINEAR ), target( NULL ),
+			clear( false ), present( false ), deferred( false ) { }
+
+		std::vector<TriangleSetup>			triangles;
+		std::vector<std::vector<uint32>>	bins;
+		RasterFunc		rasterFunc;
+		const Texture*	texture;
+		TextureFilter	textureFilter;
+		Light			light;
+		Vector			camEye;
+		uint32*			target;		// color buffer of the frame the batch belongs to
+		bool			clear;		// clears color and depth before its triangles
+		bool			present;	// fills the tiles nothing was drawn to after them
+		bool			deferred;	// runs the lighting pass over the g-buffer before that
+
+		// lighting pass state, captured by the present batch of a deferred frame
+		Matrix					viewProjection;
+		Matrix					inverseViewProjection;
+		std::vector<Light>		lights;
+		std::vector<PointLight>	pointLights;
+	};
+
 	inline	Device( ) : transform( NULL ), textures( NULL ), framebuffer( NULL ), zbuffer( NULL ),
-		width( 0 ), height( 0 ), illuminationMode( IlluminationMode::COLOR ), light( NULL ), camEye( { 1.0f, 0.f, 0.f, 0.f } ) { }
+		width( 0 ), height( 0 ), depthFormat( DepthFormat::FLOAT32 ), depthScale( 1.f ), clearDepth( 1.f ),
+		illuminationMode( IlluminationMode::COLOR ), light( NULL ), camEye( { 1.0f, 0.f, 0.f, 0.f } ),
+		vertexCache( NULL ), vertexCacheSize( 0 ), vertexStreams( NULL ), threadPool( NULL ), tilesX( 0 ), tilesY( 0 ), simdShading( true ),
+		hizBlockMin( NULL ), hizBlockMax( NULL ), hizTileMax( NULL ), blocksX( 0 ), blocksY( 0 ),
+		texture( NULL ), textureFilter( TextureFilter::TRILINEAR ), tileCleared( NULL ), fastClear( true ), depthOnly( false ),
+		record( NULL ), raster( NULL ), rasterQueue( NULL ), pipelineDepth( 1 ), outputBuffer( NULL ), colorBuffers( NULL ),
+		frameIndex( 0 ), framesShown( 0 ), gbufferNormal( NULL ), extraLights( NULL ), extraLightCount( 0 ), pointLights( NULL ),
+		pointLightCount( 0 ), deferredFrame( false ), sampleCount( 1 ), sampleDepth( NULL ), sampleSlot( NULL ), shaderContext( NULL ),
+		shadeGroup( NULL ), varyingCount( 0 ), unpackedVertices( NULL ), unpackedSize( 0 ), unpackedMesh( NULL ),
+		pixelsWritten( 0 ) { }
 
 	void	init( int w, int h, uint32* fb, Transform* ts, int** tex, Light* light, IlluminationMode illuminationMode );
 	void	SetCamera( float x, float y, float z );
+	void	setThreadCount( int count );
+	inline void	setSimdShading( bool enable ) { simdShading = enable; }
+	inline void	setTexture( const Texture* tex, TextureFilter filter ) { texture = tex; textureFilter = filter; }
+	inline void	setFastClear( bool enable ) { fastClear = enable; }
+	inline void	setIlluminationMode( IlluminationMode mode ) { illuminationMode = mode; }
+	// drawTriangle3d and drawMesh only test and write depth, with exactly the depths the shading paths compute,
+	// for shadow maps and z prepasses; triangles recorded either way are flushed before it changes
+	inline void	setDepthOnly( bool enable ) { if ( enable != depthOnly ) flush( ); depthOnly = enable; }
+	// reallocates the depth buffer in the given format, so every frame after a change has to start with clear( )
+	void	setDepthFormat( DepthFormat format );
+	inline DepthFormat	getDepthFormat( ) const { return depthFormat; }
+	// what the depth test compares for a projected depth z, smaller being nearer in every format: z itself,
+	// - z for FLOAT32_REVERSED and z scaled to the integer range of a unorm format, rounded where it is tested.
+	// drawPoint2d takes projected depths as well
+	inline float	getDepthKey( float z ) const { return z * depthScale; }
+	// depth buffer at pixel ( x, y ) as a key
+	inline float	getDepth( int x, int y ) const { return depthAt( y * width + x ); }
+	// 1, 4 or 8 coverage and depth samples per pixel for the forward illumination modes, shaded once per pixel
+	// and triangle and averaged into the color buffer at present( ). DEFERRED, depth only and drawShaded
+	// triangles, points and lines keep writing one sample per pixel, so a multisampled frame should not mix
+	// them in; every frame after a change has to start with clear( )
+	void	setSampleCount( int count );
+	inline int	getSampleCount( ) const { return sampleCount; }
+	// pixels triangles passed the depth test in and wrote since init( ), counted in every build; up to date for
+	// the frames finish( ) waited for
+	inline long long	getPixelsWritten( ) const { return pixelsWritten; }
+	// lights of IlluminationMode::DEFERRED next to the init( ) light; the arrays are copied when the frame is
+	// presented, point lights only reach the screen tiles their sphere overlaps
+	inline void	setLights( const Light* directional, int directionalCount, const PointLight* points, int pointCount )
+	{
+		extraLights = directional;
+		extraLightCount = directionalCount;
+		pointLights = points;
+		pointLightCount = pointCount;
+	}
+	// frames in flight. 1 rasterizes every flush( ) on the calling thread; 2 or 3 hand the flushed batches to a
+	// raster thread and render into as many internal color buffers, so transform, clipping and binning of the
+	// next frame run while the previous one is rasterized, and present( ) copies the oldest finished frame,
+	// depth - 1 frames behind, into the framebuffer passed to init( ). every frame has to start with clear( ),
+	// and textures must stay alive until finish( )
+	void	setPipelineDepth( int depth );
+	inline int	getPipelineDepth( ) const { return pipelineDepth; }
 	void	clear( );
+	void	flush( );
+	void	present( );
+	// waits for every presented frame and leaves the latest one in the framebuffer passed to init( )
+	void	finish( );
 	void	close( );
 
 	void	drawPoint2d( const Vertex& sv );
 	void	drawLine3d( const Vertex& wv1, const Vertex& wv2 );
 	void	drawTriangle3d( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3 );
+	void	drawMesh( const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount );
+	void	drawMesh( const Vertex* vertices, int vertexCount, const uint16* indices, int indexCount );
+	// decodes the vertices into a scratch buffer and draws them like the above; drawing the same mesh again
+	// before present( ), as instances do, reuses that decode, so it must not change in between
+	void	drawMesh( const PackedMesh& mesh );
+	// line list: every index pair is one segment, drawn immediately like drawLine3d
+	void	drawLines( const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount );
+	// indexed triangle list through a user shader instead of the fixed illumination modes, defined in Shader.h;
+	// rasterized before it returns, so the shader only has to outlive the call
+	template<class Shader>
+	void	drawShaded( const Shader& shader, const typename Shader::Input* vertices, int vertexCount,
+				const uint32* indices, int indexCount );
+
+	void	transformVertex( TransformedVertex& tv, const Vertex& wv );
+	void	transformVertices( const Vertex* vertices, int vertexCount );
+	void	rasterLine( const Vertex& wv1, const Vertex& wv2, const Vector& clip1, const Vector& clip2 );
+	void	submitTriangle( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3,
+				const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 );
+	void	clipTriangle( const Vertex& wv1, const Vertex& wv2, const Vertex& wv3,
+				const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 );
+	bool	setupTriangle( TriangleSetup& ts, const Vertex& wv1, const Vertex& wv2, const Vertex& wv3,
+				const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 );
+	bool	setupTriangle( TriangleSetup& ts, const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3 );
+	void	binTriangle( uint32 index );
+	void	rasterTile( int tile );
+	void	lightTile( int tile );
+	void	resolveTile( int tile, bool depth );
+	void	resolveSamples( int tile );
+	void	updateHiZ( int block );
+
+	// stages of drawShaded that do not depend on the shader type
+	void	projectVertex( TransformedVertex& tv, const Vector& clip );
+	void	beginShaded( const void* shader, ShadeGroupFunc shade, int count );
+	void	submitShaded( const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3,
+				const float* va1, const float* va2, const float* va3 );
+	void	clipShaded( const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3,
+				const float* va1, const float* va2, const float* va3 );
+	void	setupShaded( const TransformedVertex& tv1, const TransformedVertex& tv2, const TransformedVertex& tv3,
+				const float* va1, const float* va2, const float* va3 );
+	void	endShaded( );
+	int		rasterShaded( const TriangleSetup& ts, int x0, int y0, int x1, int y1 );
+
+	// raster and shade loops specialized on the illumination mode, texturing and SIMD shading, so each
+	// combination only interpolates the varyings it reads; defined and instantiated in Device.cpp
+	template<IlluminationMode MODE, bool TEXTURED, bool SIMD>
+	int		rasterTriangle( const TriangleSetup& ts, int x0, int y0, int x1, int y1 );
+	template<IlluminationMode MODE, bool TEXTURED>
+	bool	shadePixel( const TriangleSetup& ts, int x, int y, float sf1, float sf2 );
+	template<IlluminationMode MODE, bool TEXTURED>
+	int		shadeQuad( const TriangleSetup& ts, int x, int y, vfloat sf1, vfloat sf2, int mask, bool depthTest );
+	template<IlluminationMode MODE, bool TEXTURED>
+	void	shadeColors( const TriangleSetup& ts, vfloat sf1, vfloat sf2, int mask, uint32* colors, uint32* normals );
+	template<IlluminationMode MODE, bool TEXTURED, int SAMPLES>
+	int		rasterMultisample( const TriangleSetup& ts, int x0, int y0, int x1, int y1 );
+	template<bool SIMD>
+	int		rasterDepth( const TriangleSetup& ts, int x0, int y0, int x1, int y1 );
 
 	bool	checkCvv( const Vertex& v );
 	bool	triInterp_Barycentric( const Vector& v1, const Vector& v2, const Vector& v3, const Vector& p, float& u, float& v );
 
-	Color	diffusePS( const Vertex& sv, const Vector& normal );
-	Color	phonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye );
-	Color	blinnPhonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye );
+	// lit is the fraction of the light its shadow map lets through
+	Color	diffusePS( const Vertex& sv, const Vector& normal, float lit );
+	Color	phonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye, float lit );
+	Color	blinnPhonePS( const Vertex& sv, const Vector& normal, const Vector& pos, const Vector& camEye, float lit );
 
 private:
+	Batch*	newBatch( );
+	void	executeBatch( Batch* batch );
+	void	setTarget( uint32* target );
+	void	sync( );
+	void	showFrame( int frame );
+	// sv.pos.z is a key, see getDepthKey( )
+	bool	plotPoint( const Vertex& sv );
+	template<class Index>
+	void	drawIndexed( const Vertex* vertices, int vertexCount, const Index* indices, int indexCount );
+
+	// zbuffer access in keys: single pixels, the lanes in mask of SIMD_WIDTH pixels from p on, and keys
+	// rounded the way the buffer holds them
+	inline float	depthAt( int p ) const
+	{
+		if ( depthFormat == DepthFormat::UNORM16 ) return ( ( const uint16* )zbuffer )[p];
+		if ( depthFormat == DepthFormat::UNORM24 ) return ( float )( ( const int* )zbuffer )[p];
+		return ( ( const float* )zbuffer )[p];
+	}
+	void	setDepth( int p, float key );
+	void	fillDepth( int p, int count, float key );
+	void	loadDepth( float* keys, int p, int mask ) const;
+	void	storeDepth( int p, const float* keys, int mask );
+	float	roundDepth( float key ) const;
+	vfloat	roundDepth( vfloat key ) const;
+
 	Transform*	transform;
 	Light*		light;
 	int**		textures;
-	float *		zbuffer;
+	void *		zbuffer;
 	uint32 **	framebuffer;
 	int			width;
 	int			height;
+
+	// zbuffer holds floats, or 24 bit ints or uint16 for the unorm formats; depthScale turns projected depths
+	// into keys and clearDepth is the key of the far plane
+	DepthFormat	depthFormat;
+	float		depthScale;
+	float		clearDepth;
 	Vector		camEye;
 	IlluminationMode	illuminationMode;
+	TransformedVertex*	vertexCache;
+	int					vertexCacheSize;
+	// SoA position, clip and screen streams of drawMesh, one allocation sized with vertexCache
+	float*				vertexStreams;
+	VectorSoA			streamPos;
+	VectorSoA			streamClip;
+	VectorSoA			streamScreen;
+
+	// triangles are set up at draw time, binned into screen tiles and rasterized tile-parallel by flush( ),
+	// so light, camera and illumination mode are read when the bins are flushed
+	ThreadPool*							threadPool;
+	int									tilesX;
+	int									tilesY;
+
+	// shade SIMD_WIDTH pixels of a row at once in SoA form instead of calling shadePixel per pixel;
+	// the result stays within 1/255 per channel of the scalar path ( one newton step after rsqrt,
+	// integer power by squaring instead of pow )
+	bool								simdShading;
+
+	// hierarchical z next to zbuffer: min / max depth of every 8x8 raster block and max depth of every tile,
+	// used to reject triangles and blocks before interpolation and to skip depth reads of unoccluded blocks
+	float*								hizBlockMin;
+	float*								hizBlockMax;
+	float*								hizTileMax;
+	int									blocksX;
+	int									blocksY;
+
+	// modulates the vertex color when set, the mip level is picked once per shaded quad
+	const Texture*						texture;
+	TextureFilter						textureFilter;
+
+	// per tile flag set by clear( ): the tile logically holds the clear color and depth but its memory has not
+	// been written yet; fastClear off fills every tile right in clear( ) instead
+	unsigned char*						tileCleared;
+	bool								fastClear;
+	bool								depthOnly;
+
+	// draw calls bin into record, the raster side works on raster. with a pipeline the batches flushed to
+	// rasterQueue stay in queuedBatches until their ticket has run and are then reused
+	Batch*											record;
+	Batch*											raster;
+	std::deque<std::pair<unsigned long long, Batch*>>	queuedBatches;
+	std::vector<Batch*>								freeBatches;
+	JobQueue*										rasterQueue;
+
+	// pipelineDepth color buffers in one allocation, frame n renders into buffer n % pipelineDepth and is
+	// copied to outputBuffer once its present batch, frameTickets of that buffer, has run
+	int									pipelineDepth;
+	uint32*								outputBuffer;
+	uint32*								colorBuffers;
+	unsigned long long					frameTickets[MAX_PIPELINE_DEPTH];
+	int									frameIndex;
+	int									framesShown;
+
+	// g-buffer of IlluminationMode::DEFERRED: albedo goes to the color buffer and depth to zbuffer, the normal
+	// here packed 10:10:10 with the top bits set where a deferred triangle was written this frame. forward
+	// pixels drawn over those are lit as well, so a frame should not mix the two
+	uint32*								gbufferNormal;
+	const Light*						extraLights;
+	int									extraLightCount;
+	const PointLight*					pointLights;
+	int									pointLightCount;
+	bool								deferredFrame;		// a batch of the frame being recorded was deferred
+
+	// multisampling: sampleCount depth keys per pixel in sampleDepth, with zbuffer holding the farthest of them for
+	// the hierarchical z. a pixel covered by one triangle keeps its single color in the color buffer, an edge
+	// pixel gets sampleCount colors in the sampleColors store of its tile, sampleSlot indexes them
+	int									sampleCount;
+	float*								sampleDepth;
+	unsigned short*						sampleSlot;
+	std::vector<std::vector<uint32>>	sampleColors;
+
+	// state of the drawShaded call in progress: per triangle plane equations of 1 / w, depth and every varying
+	// divided by w, and the per vertex outputs of the shader's vertex stage
+	const void*							shaderContext;
+	ShadeGroupFunc						shadeGroup;
+	int									varyingCount;
+	std::vector<float>					varyingPlanes;
+	std::vector<TransformedVertex>		shadedVertices;
+	std::vector<float>					shadedVaryings;
+
+	// vertices of the PackedMesh drawn last, decoded this frame
+	Vertex*								unpackedVertices;
+	int									unpackedSize;
+	const PackedMesh*					unpackedMesh;
+
+	// summed over the tiles by the raster workers
+	std::atomic<long long>				pixelsWritten;
 };
\ No newline at end of file
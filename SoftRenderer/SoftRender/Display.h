@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Config.h"
+#include <stddef.h>
+
+// presentation target the device renders into, implemented by the win32 Screen and the headless OffscreenScreen
+class Display
+{
+public:
+	virtual ~Display( ) { }
+
+	virtual void	update( ) = 0;
+	virtual void	dispatch( ) = 0;
+	virtual void	close( ) = 0;
+	virtual int		isExit( ) = 0;
+	virtual uint32*	getFrameBuffer( ) = 0;
+};
\ No newline at end of file
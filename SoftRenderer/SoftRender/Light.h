@@ -3,8 +3,21 @@
 #include "math.h"
 #include "Vertex.h"
 
+class ShadowMap;
+
+// shadow, when set, is a map rendered along direction that the lighting samples with PCF; it is read when
+// the frames drawn with this light are rasterized, so a pipelined Device has to finish( ) before it is redrawn
 struct Light
 {
 	Vector direction;
 	Color color;
+	const ShadowMap* shadow;
+};
+
+// light of IlluminationMode::DEFERRED, fading out smoothly to nothing at radius
+struct PointLight
+{
+	Vector position;
+	Color color;
+	float radius;
 };
\ No newline at end of file
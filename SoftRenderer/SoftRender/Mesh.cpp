@@ -0,0 +1,211 @@
+#include "Mesh.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MESH_CACHE_MAGIC 0x4d525253 // "SRRM"
+#define MESH_CACHE_VERSION 1
+
+struct MeshCacheHeader
+{
+	uint32		magic;
+	uint32		version;
+	uint32		vertexSize;
+	uint32		vertexCount;
+	uint32		indexCount;
+	uint32		reserved;
+	long long	sourceSize;
+	long long	sourceTime;
+};
+
+void ComputeMeshBounds( Vector& min, Vector& max, const Vertex* vertices, int vertexCount )
+{
+	min = { 0.f, 0.f, 0.f, 1.f };
+	max = { 0.f, 0.f, 0.f, 1.f };
+	if ( vertexCount <= 0 ) return;
+
+	min = vertices[0].pos;
+	max = vertices[0].pos;
+	for ( int i = 1; i < vertexCount; i ++ )
+	{
+		const Vector& p = vertices[i].pos;
+		min.x = std::min( min.x, p.x );
+		min.y = std::min( min.y, p.y );
+		min.z = std::min( min.z, p.z );
+		max.x = std::max( max.x, p.x );
+		max.y = std::max( max.y, p.y );
+		max.z = std::max( max.z, p.z );
+	}
+}
+
+void BuildEdgeIndices( std::vector<uint32>& edges, const uint32* indices, int indexCount )
+{
+	// an edge shared by two triangles shows up once as ( min, max ) after sorting
+	std::vector<unsigned long long> keys;
+	keys.reserve( indexCount );
+	for ( int i = 0; i + 2 < indexCount; i += 3 )
+	{
+		for ( int k = 0; k < 3; k ++ )
+		{
+			uint32 a = indices[i + k], b = indices[i + ( k + 1 ) % 3];
+			keys.push_back( ( ( unsigned long long )std::min( a, b ) << 32 ) | std::max( a, b ) );
+		}
+	}
+	std::sort( keys.begin( ), keys.end( ) );
+	keys.erase( std::unique( keys.begin( ), keys.end( ) ), keys.end( ) );
+
+	edges.resize( keys.size( ) * 2 );
+	for ( size_t i = 0; i < keys.size( ); i ++ )
+	{
+		edges[i * 2] = ( uint32 )( keys[i] >> 32 );
+		edges[i * 2 + 1] = ( uint32 )keys[i];
+	}
+}
+
+int SaveMeshCache( const Mesh& mesh, const char* path, long long sourceSize, long long sourceTime )
+{
+	// other runs may have the cache mapped, so it is written next to it under a name of this process and then
+	// renamed over it; a reader keeps the old file until it unmaps it, and never sees a half written one
+#ifdef _WIN32
+	long long pid = ( long long )GetCurrentProcessId( );
+#else
+	long long pid = ( long long )getpid( );
+#endif
+	std::string tempPath = std::string( path ) + "." + std::to_string( pid ) + ".tmp";
+
+	FILE* fp = fopen( tempPath.c_str( ), "wb" );
+	if ( fp == NULL ) return -1;
+
+	MeshCacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof( Vertex );
+	header.vertexCount = ( uint32 )mesh.vertices.size( );
+	header.indexCount = ( uint32 )mesh.indices.size( );
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+
+	bool ok = fwrite( &header, sizeof( header ), 1, fp ) == 1;
+	if ( ok && header.vertexCount > 0 )
+		ok = fwrite( mesh.vertices.data( ), sizeof( Vertex ), header.vertexCount, fp ) == header.vertexCount;
+	if ( ok && header.indexCount > 0 )
+		ok = fwrite( mesh.indices.data( ), sizeof( uint32 ), header.indexCount, fp ) == header.indexCount;
+
+	if ( fclose( fp ) != 0 ) ok = false;
+	if ( !ok )
+	{
+		remove( tempPath.c_str( ) );
+		return -2;
+	}
+
+#ifdef _WIN32
+	ok = MoveFileExA( tempPath.c_str( ), path, MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+	ok = rename( tempPath.c_str( ), path ) == 0;
+#endif
+	if ( !ok )
+	{
+		remove( tempPath.c_str( ) );
+		return -3;
+	}
+
+	return 0;
+}
+
+int MeshCache::open( const char* path )
+{
+	close( );
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file == INVALID_HANDLE_VALUE ) return -1;
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( file, &fileSize ) ) { close( ); return -2; }
+	size = ( size_t )fileSize.QuadPart;
+	if ( size < sizeof( MeshCacheHeader ) ) { close( ); return -3; }
+
+	mapHandle = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( mapHandle == NULL ) { close( ); return -2; }
+
+	data = MapViewOfFile( mapHandle, FILE_MAP_READ, 0, 0, 0 );
+	if ( data == NULL ) { close( ); return -2; }
+#else
+	int fd = ::open( path, O_RDONLY );
+	if ( fd < 0 ) return -1;
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 ) { ::close( fd ); return -2; }
+	size = ( size_t )st.st_size;
+	if ( size < sizeof( MeshCacheHeader ) ) { ::close( fd ); return -3; }
+
+	void* p = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+	if ( p == MAP_FAILED ) return -2;
+	data = p;
+#endif
+
+	const MeshCacheHeader* header = ( const MeshCacheHeader* )data;
+	size_t expected = sizeof( MeshCacheHeader ) + ( size_t )header->vertexCount * sizeof( Vertex ) + ( size_t )header->indexCount * sizeof( uint32 );
+	if ( header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+		header->vertexSize != sizeof( Vertex ) || expected != size )
+	{
+		close( );
+		return -3;
+	}
+
+	vertexCount = ( int )header->vertexCount;
+	indexCount = ( int )header->indexCount;
+	sourceSize = header->sourceSize;
+	sourceTime = header->sourceTime;
+	vertices = ( const Vertex* )( ( const char* )data + sizeof( MeshCacheHeader ) );
+	indices = ( const uint32* )( vertices + vertexCount );
+
+	return 0;
+}
+
+void MeshCache::adopt( Mesh& mesh )
+{
+	close( );
+
+	owned.vertices.swap( mesh.vertices );
+	owned.indices.swap( mesh.indices );
+	vertices = owned.vertices.data( );
+	indices = owned.indices.data( );
+	vertexCount = ( int )owned.vertices.size( );
+	indexCount = ( int )owned.indices.size( );
+}
+
+void MeshCache::close( )
+{
+#ifdef _WIN32
+	if ( data != NULL ) UnmapViewOfFile( data );
+	if ( mapHandle != NULL ) CloseHandle( ( HANDLE )mapHandle );
+	if ( fileHandle != NULL ) CloseHandle( ( HANDLE )fileHandle );
+#else
+	if ( data != NULL ) munmap( data, size );
+#endif
+
+	data = NULL;
+	size = 0;
+	vertices = NULL;
+	indices = NULL;
+	vertexCount = 0;
+	indexCount = 0;
+	fileHandle = NULL;
+	mapHandle = NULL;
+	owned.vertices.clear( );
+	owned.indices.clear( );
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Config.h"
+#include "math.h"
+#include "Vertex.h"
+#include <stddef.h>
+#include <vector>
+
+struct Mesh
+{
+	std::vector<Vertex>	vertices;
+	std::vector<uint32>	indices;
+};
+
+void	ComputeMeshBounds( Vector& min, Vector& max, const Vertex* vertices, int vertexCount );
+// line list of the unique edges of a triangle list, for Device::drawLines wireframes
+void	BuildEdgeIndices( std::vector<uint32>& edges, const uint32* indices, int indexCount );
+
+// quadric error edge collapse down to about targetTriangles, returns the triangles left. positions only ever
+// collapse onto a neighbour, so every output vertex is a copy of an input vertex
+int		SimplifyMesh( Mesh& out, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount, int targetTriangles );
+// chain of coarser levels for SceneMesh: each one has about half the triangles of the one before it ( lods[0]
+// half of the input ), until levels, minTriangles or a mesh that will not shrink any more ends it
+void	BuildMeshLods( std::vector<Mesh>& lods, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount,
+	int levels, int minTriangles );
+
+// binary mesh cache: a header followed by the raw Vertex array and the uint32 index array,
+// written once from a parsed mesh and mapped read-only by later runs
+int		SaveMeshCache( const Mesh& mesh, const char* path, long long sourceSize, long long sourceTime );
+
+class MeshCache
+{
+public:
+	inline MeshCache( ) : data( NULL ), size( 0 ), vertices( NULL ), indices( NULL ), vertexCount( 0 ), indexCount( 0 ),
+		sourceSize( 0 ), sourceTime( 0 ), fileHandle( NULL ), mapHandle( NULL ) { }
+	inline ~MeshCache( ) { close( ); }
+
+	int		open( const char* path );
+	// takes over a parsed mesh instead, for when the cache file could not be written
+	void	adopt( Mesh& mesh );
+	void	close( );
+
+	inline const Vertex*	getVertices( ) const { return vertices; }
+	inline const uint32*	getIndices( ) const { return indices; }
+	inline int				getVertexCount( ) const { return vertexCount; }
+	inline int				getIndexCount( ) const { return indexCount; }
+	inline long long		getSourceSize( ) const { return sourceSize; }
+	inline long long		getSourceTime( ) const { return sourceTime; }
+
+private:
+	MeshCache( const MeshCache& );
+	MeshCache& operator = ( const MeshCache& );
+
+	void*			data;
+	size_t			size;
+	const Vertex*	vertices;
+	const uint32*	indices;
+	int				vertexCount;
+	int				indexCount;
+	long long		sourceSize;
+	long long		sourceTime;
+	void*			fileHandle;
+	void*			mapHandle;
+	Mesh			owned;
+};
\ No newline at end of file
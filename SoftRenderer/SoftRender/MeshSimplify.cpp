@@ -0,0 +1,300 @@
+#include "Mesh.h"
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+// garland-heckbert quadric error simplification. vertices sharing a position are welded for the error metric,
+// and every collapse moves a position onto one of its neighbours, so no new vertices are created and each
+// output vertex keeps the attributes of an input vertex
+
+// upper triangle of the symmetric 4x4 error matrix, sum of squared distances to a set of planes
+struct Quadric
+{
+	double	q[10];
+};
+
+static inline void QuadricSetPlane( Quadric& Q, double a, double b, double c, double d, double weight )
+{
+	Q.q[0] = a * a * weight; Q.q[1] = a * b * weight; Q.q[2] = a * c * weight; Q.q[3] = a * d * weight;
+	Q.q[4] = b * b * weight; Q.q[5] = b * c * weight; Q.q[6] = b * d * weight;
+	Q.q[7] = c * c * weight; Q.q[8] = c * d * weight;
+	Q.q[9] = d * d * weight;
+}
+
+static inline void QuadricAdd( Quadric& Q, const Quadric& R )
+{
+	for ( int i = 0; i < 10; i ++ ) Q.q[i] += R.q[i];
+}
+
+static inline double QuadricError( const Quadric& Q, const Quadric& R, const Vector& p )
+{
+	double q[10];
+	for ( int i = 0; i < 10; i ++ ) q[i] = Q.q[i] + R.q[i];
+	double x = p.x, y = p.y, z = p.z;
+	double e = q[0] * x * x + q[4] * y * y + q[7] * z * z + q[9] +
+		2.0 * ( q[1] * x * y + q[2] * x * z + q[3] * x + q[5] * y * z + q[6] * y + q[8] * z );
+	return std::max( e, 0.0 );
+}
+
+// position a collapses onto position b; stale once either side changed after the entry was queued
+struct Collapse
+{
+	double		cost;
+	int			from;
+	int			to;
+	unsigned	fromVersion;
+	unsigned	toVersion;
+
+	inline bool operator > ( const Collapse& c ) const { return cost > c.cost; }
+};
+
+static inline double Cross( const Vector& p0, const Vector& p1, const Vector& p2, double* n )
+{
+	double ux = p1.x - p0.x, uy = p1.y - p0.y, uz = p1.z - p0.z;
+	double vx = p2.x - p0.x, vy = p2.y - p0.y, vz = p2.z - p0.z;
+	n[0] = uy * vz - uz * vy;
+	n[1] = uz * vx - ux * vz;
+	n[2] = ux * vy - uy * vx;
+	return sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+}
+
+static inline float AttributeDistance( const Vertex& a, const Vertex& b )
+{
+	float dn = ( a.normal.x - b.normal.x ) * ( a.normal.x - b.normal.x ) + ( a.normal.y - b.normal.y ) * ( a.normal.y - b.normal.y ) +
+		( a.normal.z - b.normal.z ) * ( a.normal.z - b.normal.z );
+	float dt = ( a.tex.u - b.tex.u ) * ( a.tex.u - b.tex.u ) + ( a.tex.v - b.tex.v ) * ( a.tex.v - b.tex.v );
+	float dc = ( a.color.r - b.color.r ) * ( a.color.r - b.color.r ) + ( a.color.g - b.color.g ) * ( a.color.g - b.color.g ) +
+		( a.color.b - b.color.b ) * ( a.color.b - b.color.b );
+	return dn + dt + dc;
+}
+
+int SimplifyMesh( Mesh& out, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount, int targetTriangles )
+{
+	out.vertices.clear( );
+	out.indices.clear( );
+	int triCount = indexCount / 3;
+	if ( vertexCount <= 0 || triCount <= 0 ) return 0;
+
+	// weld by exact position: sort the vertices by position and number the distinct ones
+	std::vector<int> sorted( vertexCount ), posOf( vertexCount );
+	for ( int i = 0; i < vertexCount; i ++ ) sorted[i] = i;
+	std::sort( sorted.begin( ), sorted.end( ), [vertices]( int a, int b ) {
+		const Vector& p = vertices[a].pos;
+		const Vector& q = vertices[b].pos;
+		return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+	} );
+	std::vector<Vector> pos;
+	std::vector<std::vector<int>> posVerts;
+	for ( int i = 0; i < vertexCount; i ++ )
+	{
+		const Vector& p = vertices[sorted[i]].pos;
+		if ( pos.empty( ) || !( pos.back( ) == p ) )
+		{
+			pos.push_back( p );
+			posVerts.emplace_back( );
+		}
+		posOf[sorted[i]] = ( int )pos.size( ) - 1;
+		posVerts.back( ).push_back( sorted[i] );
+	}
+	int posCount = ( int )pos.size( );
+
+	std::vector<uint32> tri( indices, indices + triCount * 3 );
+	std::vector<char> dead( triCount, 0 );
+	std::vector<std::vector<int>> posTris( posCount );
+	std::vector<Quadric> quadric( posCount );
+	for ( int p = 0; p < posCount; p ++ ) QuadricSetPlane( quadric[p], 0, 0, 0, 0, 0 );
+
+	// plane of every face, weighted by its area, accumulated at its corners
+	int live = 0;
+	std::vector<std::pair<unsigned long long, int>> edges;
+	for ( int t = 0; t < triCount; t ++ )
+	{
+		int p[3];
+		bool valid = true;
+		for ( int k = 0; k < 3; k ++ )
+		{
+			if ( tri[t * 3 + k] >= ( uint32 )vertexCount ) { valid = false; break; }
+			p[k] = posOf[tri[t * 3 + k]];
+		}
+		if ( !valid || p[0] == p[1] || p[1] == p[2] || p[0] == p[2] )
+		{
+			dead[t] = 1;
+			continue;
+		}
+
+		double n[3];
+		double len = Cross( pos[p[0]], pos[p[1]], pos[p[2]], n );
+		if ( len > 0.0 )
+		{
+			Quadric Q;
+			double a = n[0] / len, b = n[1] / len, c = n[2] / len;
+			QuadricSetPlane( Q, a, b, c, - ( a * pos[p[0]].x + b * pos[p[0]].y + c * pos[p[0]].z ), len * 0.5 );
+			for ( int k = 0; k < 3; k ++ ) QuadricAdd( quadric[p[k]], Q );
+		}
+		for ( int k = 0; k < 3; k ++ )
+		{
+			posTris[p[k]].push_back( t );
+			int a = std::min( p[k], p[( k + 1 ) % 3] ), b = std::max( p[k], p[( k + 1 ) % 3] );
+			edges.push_back( { ( ( unsigned long long )a << 32 ) | ( uint32 )b, t } );
+		}
+		live ++;
+	}
+
+	// open borders get a heavily weighted plane through the edge and perpendicular to its face, so they keep
+	// their outline instead of being eaten away from the side
+	std::sort( edges.begin( ), edges.end( ) );
+	for ( size_t i = 0; i < edges.size( ); )
+	{
+		size_t j = i + 1;
+		while ( j < edges.size( ) && edges[j].first == edges[i].first ) j ++;
+		if ( j - i == 1 )
+		{
+			int a = ( int )( edges[i].first >> 32 ), b = ( int )( edges[i].first & 0xffffffff ), t = edges[i].second;
+			double n[3], e[3] = { pos[b].x - pos[a].x, pos[b].y - pos[a].y, pos[b].z - pos[a].z };
+			Cross( pos[posOf[tri[t * 3]]], pos[posOf[tri[t * 3 + 1]]], pos[posOf[tri[t * 3 + 2]]], n );
+			double c[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+			double len = sqrt( c[0] * c[0] + c[1] * c[1] + c[2] * c[2] );
+			if ( len > 0.0 )
+			{
+				Quadric Q;
+				double el = sqrt( e[0] * e[0] + e[1] * e[1] + e[2] * e[2] );
+				c[0] /= len; c[1] /= len; c[2] /= len;
+				QuadricSetPlane( Q, c[0], c[1], c[2], - ( c[0] * pos[a].x + c[1] * pos[a].y + c[2] * pos[a].z ), el * el * 1000.0 );
+				QuadricAdd( quadric[a], Q );
+				QuadricAdd( quadric[b], Q );
+			}
+		}
+		i = j;
+	}
+
+	std::vector<unsigned> version( posCount, 0 );
+	std::vector<char> alive( posCount, 1 );
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+	auto push = [&]( int a, int b ) {
+		heap.push( { QuadricError( quadric[a], quadric[b], pos[b] ), a, b, version[a], version[b] } );
+		heap.push( { QuadricError( quadric[a], quadric[b], pos[a] ), b, a, version[b], version[a] } );
+	};
+	for ( size_t i = 0; i < edges.size( ); i ++ )
+	{
+		if ( i > 0 && edges[i].first == edges[i - 1].first ) continue;
+		push( ( int )( edges[i].first >> 32 ), ( int )( edges[i].first & 0xffffffff ) );
+	}
+
+	while ( live > targetTriangles && !heap.empty( ) )
+	{
+		Collapse c = heap.top( );
+		heap.pop( );
+		int a = c.from, b = c.to;
+		if ( !alive[a] || !alive[b] || c.fromVersion != version[a] || c.toVersion != version[b] ) continue;
+
+		// refuse collapses that would fold a face over or squash it flat
+		bool flips = false;
+		for ( size_t i = 0; i < posTris[a].size( ) && !flips; i ++ )
+		{
+			int t = posTris[a][i];
+			if ( dead[t] ) continue;
+			int p[3] = { posOf[tri[t * 3]], posOf[tri[t * 3 + 1]], posOf[tri[t * 3 + 2]] };
+			if ( p[0] == b || p[1] == b || p[2] == b ) continue;
+
+			Vector q[3];
+			for ( int k = 0; k < 3; k ++ ) q[k] = pos[p[k] == a ? b : p[k]];
+			double n0[3], n1[3];
+			double l0 = Cross( pos[p[0]], pos[p[1]], pos[p[2]], n0 ), l1 = Cross( q[0], q[1], q[2], n1 );
+			flips = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.2 * l0 * l1;
+		}
+		if ( flips ) continue;
+
+		for ( size_t i = 0; i < posTris[a].size( ); i ++ )
+		{
+			int t = posTris[a][i];
+			if ( dead[t] ) continue;
+			uint32* v = &tri[t * 3];
+			if ( posOf[v[0]] == b || posOf[v[1]] == b || posOf[v[2]] == b )
+			{
+				dead[t] = 1;
+				live --;
+				continue;
+			}
+
+			// each corner moves to the vertex at b with the closest attributes, which keeps both sides of a seam
+			for ( int k = 0; k < 3; k ++ )
+			{
+				if ( posOf[v[k]] != a ) continue;
+				int best = posVerts[b][0];
+				float bestDistance = AttributeDistance( vertices[v[k]], vertices[best] );
+				for ( size_t j = 1; j < posVerts[b].size( ); j ++ )
+				{
+					float d = AttributeDistance( vertices[v[k]], vertices[posVerts[b][j]] );
+					if ( d < bestDistance ) { best = posVerts[b][j]; bestDistance = d; }
+				}
+				v[k] = best;
+			}
+			posTris[b].push_back( t );
+		}
+
+		alive[a] = 0;
+		posTris[a].clear( );
+		QuadricAdd( quadric[b], quadric[a] );
+		version[b] ++;
+
+		// every edge at b has a new cost now, the queued ones went stale with the version bump
+		std::vector<int>& around = posTris[b];
+		size_t kept = 0;
+		for ( size_t i = 0; i < around.size( ); i ++ )
+		{
+			int t = around[i];
+			if ( dead[t] ) continue;
+			around[kept ++] = t;
+			for ( int k = 0; k < 3; k ++ )
+			{
+				int p = posOf[tri[t * 3 + k]];
+				if ( p != b ) push( b, p );
+			}
+		}
+		around.resize( kept );
+	}
+
+	// compact the surviving triangles and the vertices they still use
+	std::vector<int> remap( vertexCount, -1 );
+	for ( int t = 0; t < triCount; t ++ )
+	{
+		if ( dead[t] ) continue;
+		for ( int k = 0; k < 3; k ++ )
+		{
+			uint32 v = tri[t * 3 + k];
+			if ( remap[v] < 0 )
+			{
+				remap[v] = ( int )out.vertices.size( );
+				out.vertices.push_back( vertices[v] );
+			}
+			out.indices.push_back( ( uint32 )remap[v] );
+		}
+	}
+
+	return ( int )out.indices.size( ) / 3;
+}
+
+void BuildMeshLods( std::vector<Mesh>& lods, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount,
+	int levels, int minTriangles )
+{
+	lods.clear( );
+	lods.reserve( levels );
+	for ( int l = 0; l < levels; l ++ )
+	{
+		int triangles = indexCount / 3;
+		if ( triangles / 2 < minTriangles ) break;
+
+		Mesh lod;
+		int count = SimplifyMesh( lod, vertices, vertexCount, indices, indexCount, triangles / 2 );
+
+		// a mesh that hardly shrinks any more has run out of collapses that keep its shape
+		if ( count <= 0 || count > triangles * 3 / 4 ) break;
+
+		lods.push_back( lod );
+		vertices = lods.back( ).vertices.data( );
+		vertexCount = ( int )lods.back( ).vertices.size( );
+		indices = lods.back( ).indices.data( );
+		indexCount = ( int )lods.back( ).indices.size( );
+	}
+}
\ No newline at end of file
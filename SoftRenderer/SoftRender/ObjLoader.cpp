@@ -0,0 +1,342 @@
+#include "ObjLoader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct ObjCorner
+{
+	int v, t, n;
+};
+
+// open addressing table from ( v, t, n ) corners to output vertex ids, so a line never allocates
+class CornerTable
+{
+public:
+	void init( int expected )
+	{
+		int capacity = 16;
+		while ( capacity < expected * 2 ) capacity <<= 1;
+		slots.assign( capacity, -1 );
+		mask = capacity - 1;
+		corners.clear( );
+		corners.reserve( expected );
+	}
+
+	int find( const ObjCorner& c, bool& inserted )
+	{
+		if ( ( int )corners.size( ) * 2 >= ( int )slots.size( ) ) grow( );
+
+		uint32 h = hash( c ) & mask;
+		while ( slots[h] >= 0 )
+		{
+			const ObjCorner& o = corners[slots[h]];
+			if ( o.v == c.v && o.t == c.t && o.n == c.n )
+			{
+				inserted = false;
+				return slots[h];
+			}
+			h = ( h + 1 ) & mask;
+		}
+
+		slots[h] = ( int )corners.size( );
+		corners.push_back( c );
+		inserted = true;
+		return slots[h];
+	}
+
+private:
+	static inline uint32 hash( const ObjCorner& c )
+	{
+		uint32 h = ( uint32 )c.v * 0x9E3779B1u;
+		h ^= ( uint32 )( c.t + 1 ) * 0x85EBCA77u;
+		h ^= ( uint32 )( c.n + 1 ) * 0xC2B2AE3Du;
+		return h ^ ( h >> 15 );
+	}
+
+	void grow( )
+	{
+		slots.assign( slots.size( ) * 2, -1 );
+		mask = ( uint32 )slots.size( ) - 1;
+		for ( int i = 0; i < ( int )corners.size( ); i ++ )
+		{
+			uint32 h = hash( corners[i] ) & mask;
+			while ( slots[h] >= 0 ) h = ( h + 1 ) & mask;
+			slots[h] = i;
+		}
+	}
+
+	std::vector<int>		slots;
+	std::vector<ObjCorner>	corners;
+	uint32					mask;
+};
+
+static inline bool IsBlank( char c ) { return c == ' ' || c == '\t'; }
+
+static inline void SkipBlank( const char*& p ) { while ( IsBlank( *p ) ) p ++; }
+
+static inline void SkipLine( const char*& p, const char* end )
+{
+	const char* n = ( const char* )memchr( p, '\n', end - p );
+	p = n ? n + 1 : end;
+}
+
+static float ParseFloat( const char*& p )
+{
+	SkipBlank( p );
+
+	bool negative = false;
+	if ( *p == '-' ) { negative = true; p ++; }
+	else if ( *p == '+' ) p ++;
+
+	double value = 0.0;
+	while ( *p >= '0' && *p <= '9' ) value = value * 10.0 + ( *p ++ - '0' );
+
+	if ( *p == '.' )
+	{
+		p ++;
+		double scale = 0.1;
+		while ( *p >= '0' && *p <= '9' )
+		{
+			value += ( *p ++ - '0' ) * scale;
+			scale *= 0.1;
+		}
+	}
+
+	if ( *p == 'e' || *p == 'E' )
+	{
+		p ++;
+		bool negExp = false;
+		if ( *p == '-' ) { negExp = true; p ++; }
+		else if ( *p == '+' ) p ++;
+		int e = 0;
+		while ( *p >= '0' && *p <= '9' ) e = e * 10 + ( *p ++ - '0' );
+		value *= pow( 10.0, negExp ? -e : e );
+	}
+
+	return ( float )( negative ? -value : value );
+}
+
+static bool ParseIndex( const char*& p, int count, int& index )
+{
+	bool negative = false;
+	if ( *p == '-' ) { negative = true; p ++; }
+	if ( *p < '0' || *p > '9' ) return false;
+
+	int value = 0;
+	while ( *p >= '0' && *p <= '9' ) value = value * 10 + ( *p ++ - '0' );
+
+	// obj indices are 1-based, negative ones count back from the last element read so far
+	index = negative ? count - value : value - 1;
+	return index >= 0 && index < count;
+}
+
+static bool ReadWholeFile( const char* path, char*& buffer, size_t& size )
+{
+	FILE* fp = fopen( path, "rb" );
+	if ( fp == NULL ) return false;
+
+	fseek( fp, 0, SEEK_END );
+	long length = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+	if ( length < 0 ) { fclose( fp ); return false; }
+
+	size = ( size_t )length;
+	buffer = ( char* )malloc( size + 1 );
+	if ( buffer == NULL ) { fclose( fp ); return false; }
+
+	bool ok = fread( buffer, 1, size, fp ) == size;
+	fclose( fp );
+	buffer[size] = '\0';
+	if ( !ok ) { free( buffer ); buffer = NULL; }
+
+	return ok;
+}
+
+int LoadObj( Mesh& mesh, const char* path )
+{
+	char* buffer = NULL;
+	size_t size = 0;
+	if ( !ReadWholeFile( path, buffer, size ) ) return -1;
+
+	const char* end = buffer + size;
+
+	// counting pass so that every array is allocated exactly once
+	int numPos = 0, numTex = 0, numNor = 0, numFace = 0;
+	for ( const char* p = buffer; p < end; SkipLine( p, end ) )
+	{
+		SkipBlank( p );
+		if ( p[0] == 'v' && IsBlank( p[1] ) ) numPos ++;
+		else if ( p[0] == 'v' && p[1] == 't' ) numTex ++;
+		else if ( p[0] == 'v' && p[1] == 'n' ) numNor ++;
+		else if ( p[0] == 'f' && IsBlank( p[1] ) ) numFace ++;
+	}
+
+	std::vector<Vector> positions;
+	std::vector<Texcoord> texcoords;
+	std::vector<Vector> normals;
+	positions.reserve( numPos );
+	texcoords.reserve( numTex );
+	normals.reserve( numNor );
+
+	mesh.vertices.clear( );
+	mesh.indices.clear( );
+	mesh.vertices.reserve( numPos );
+	mesh.indices.reserve( numFace * 3 );
+
+	CornerTable table;
+	table.init( std::max( numPos, 16 ) );
+
+	bool needNormals = false;
+	int ret = 0;
+	for ( const char* p = buffer; p < end && ret == 0; SkipLine( p, end ) )
+	{
+		SkipBlank( p );
+		if ( p[0] == 'v' && IsBlank( p[1] ) )
+		{
+			p ++;
+			float x = ParseFloat( p );
+			float y = ParseFloat( p );
+			float z = ParseFloat( p );
+			positions.push_back( { x, y, z, 1.f } );
+		}
+		else if ( p[0] == 'v' && p[1] == 't' )
+		{
+			p += 2;
+			float u = ParseFloat( p );
+			float v = ParseFloat( p );
+			texcoords.push_back( { u, v } );
+		}
+		else if ( p[0] == 'v' && p[1] == 'n' )
+		{
+			p += 2;
+			float x = ParseFloat( p );
+			float y = ParseFloat( p );
+			float z = ParseFloat( p );
+			normals.push_back( { x, y, z, 0.f } );
+		}
+		else if ( p[0] == 'f' && IsBlank( p[1] ) )
+		{
+			p ++;
+
+			// polygons are triangulated as a fan around their first corner
+			uint32 first = 0, prev = 0;
+			int corner = 0;
+			while ( true )
+			{
+				SkipBlank( p );
+				if ( *p == '\r' || *p == '\n' || *p == '\0' || *p == '#' ) break;
+
+				ObjCorner c = { -1, -1, -1 };
+				if ( !ParseIndex( p, ( int )positions.size( ), c.v ) ) { ret = -2; break; }
+				if ( *p == '/' )
+				{
+					p ++;
+					if ( *p != '/' && !ParseIndex( p, ( int )texcoords.size( ), c.t ) ) { ret = -2; break; }
+					if ( *p == '/' )
+					{
+						p ++;
+						if ( !ParseIndex( p, ( int )normals.size( ), c.n ) ) { ret = -2; break; }
+					}
+				}
+
+				bool inserted;
+				uint32 index = ( uint32 )table.find( c, inserted );
+				if ( inserted )
+				{
+					Vertex vert;
+					vert.pos = positions[c.v];
+					vert.color = { 1.f, 1.f, 1.f };
+					vert.tex = c.t >= 0 ? texcoords[c.t] : Texcoord { 0.f, 0.f };
+					vert.normal = c.n >= 0 ? normals[c.n] : Vector { 0.f, 0.f, 0.f, 0.f };
+					if ( c.n < 0 ) needNormals = true;
+					mesh.vertices.push_back( vert );
+				}
+
+				if ( corner == 0 ) first = index;
+				else if ( corner >= 2 )
+				{
+					mesh.indices.push_back( first );
+					mesh.indices.push_back( prev );
+					mesh.indices.push_back( index );
+				}
+				prev = index;
+				corner ++;
+			}
+		}
+	}
+
+	free( buffer );
+	if ( ret < 0 )
+	{
+		mesh.vertices.clear( );
+		mesh.indices.clear( );
+		return ret;
+	}
+
+	if ( needNormals )
+	{
+		// area weighted face normals accumulated on the vertices that came without one
+		std::vector<char> generated( mesh.vertices.size( ) );
+		for ( size_t i = 0; i < mesh.vertices.size( ); i ++ )
+			generated[i] = mesh.vertices[i].normal.x == 0.f && mesh.vertices[i].normal.y == 0.f && mesh.vertices[i].normal.z == 0.f;
+
+		for ( size_t i = 0; i + 2 < mesh.indices.size( ); i += 3 )
+		{
+			Vertex& a = mesh.vertices[mesh.indices[i]];
+			Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+			Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+			Vector n;
+			VectorCrossProduct( n, b.pos - a.pos, c.pos - a.pos );
+			if ( generated[mesh.indices[i]] ) a.normal = a.normal + n;
+			if ( generated[mesh.indices[i + 1]] ) b.normal = b.normal + n;
+			if ( generated[mesh.indices[i + 2]] ) c.normal = c.normal + n;
+		}
+
+		for ( size_t i = 0; i < mesh.vertices.size( ); i ++ )
+		{
+			if ( !generated[i] ) continue;
+			VectorNormalize( mesh.vertices[i].normal );
+			mesh.vertices[i].normal.w = 0.f;
+		}
+	}
+
+	return 0;
+}
+
+static int GetFileStamp( const char* path, long long& size, long long& time )
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if ( _stat64( path, &st ) != 0 ) return -1;
+#else
+	struct stat st;
+	if ( stat( path, &st ) != 0 ) return -1;
+#endif
+	size = ( long long )st.st_size;
+	time = ( long long )st.st_mtime;
+	return 0;
+}
+
+int LoadObjCached( MeshCache& cache, const char* path )
+{
+	long long size, time;
+	if ( GetFileStamp( path, size, time ) < 0 ) return -1;
+
+	std::string cachePath = std::string( path ) + ".srmesh";
+	if ( cache.open( cachePath.c_str( ) ) == 0 && cache.getSourceSize( ) == size && cache.getSourceTime( ) == time )
+		return 0;
+	cache.close( );
+
+	Mesh mesh;
+	int ret = LoadObj( mesh, path );
+	if ( ret < 0 ) return ret;
+
+	// a cache that can not be written or mapped ( read-only directory, say ) only costs the next run a parse
+	if ( SaveMeshCache( mesh, cachePath.c_str( ), size, time ) < 0 || cache.open( cachePath.c_str( ) ) < 0 )
+		cache.adopt( mesh );
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Mesh.h"
+
+// parses positions, texcoords, normals and (polygon) faces of a wavefront obj file into
+// deduplicated vertex and index buffers; vertex normals are generated when the file has none
+int		LoadObj( Mesh& mesh, const char* path );
+
+// maps "<path>.srmesh", (re)building it from the obj file first if it is missing or stale; when the cache
+// can not be written the parsed mesh is kept in memory instead
+int		LoadObjCached( MeshCache& cache, const char* path );
\ No newline at end of file
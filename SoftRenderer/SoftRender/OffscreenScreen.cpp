@@ -0,0 +1,62 @@
+#include "OffscreenScreen.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+int OffscreenScreen::init( int w, int h )
+{
+	close( );
+
+	framebuffer = ( uint32* )malloc( w * h * sizeof( uint32 ) );
+	if ( framebuffer == NULL ) return -1;
+
+	width = w;
+	height = h;
+	frameCount = 0;
+	memset( framebuffer, 0, w * h * 4 );
+
+	return 0;
+}
+
+void OffscreenScreen::update( )
+{
+	frameCount ++;
+}
+
+void OffscreenScreen::close( )
+{
+	if ( framebuffer != NULL )
+	{
+		free( framebuffer );
+		framebuffer = NULL;
+	}
+}
+
+uint32* OffscreenScreen::getFrameBuffer( )
+{
+	return framebuffer;
+}
+
+int OffscreenScreen::savePPM( const char* path )
+{
+	FILE* fp = fopen( path, "wb" );
+	if ( fp == NULL ) return -1;
+
+	fprintf( fp, "P6\n%d %d\n255\n", width, height );
+	unsigned char* row = ( unsigned char* )malloc( width * 3 );
+	for ( int y = 0; y < height; y ++ )
+	{
+		for ( int x = 0; x < width; x ++ )
+		{
+			uint32 c = framebuffer[y * width + x];
+			row[x * 3 + 0] = ( c >> 16 ) & 0xff;
+			row[x * 3 + 1] = ( c >> 8 ) & 0xff;
+			row[x * 3 + 2] = c & 0xff;
+		}
+		fwrite( row, 1, width * 3, fp );
+	}
+	free( row );
+	fclose( fp );
+
+	return 0;
+}
\ No newline at end of file
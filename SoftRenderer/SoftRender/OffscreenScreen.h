@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Display.h"
+
+// in-memory framebuffer without any window, used for batch rendering on headless machines
+class OffscreenScreen : public Display
+{
+public:
+	inline OffscreenScreen( ) : framebuffer( NULL ), width( 0 ), height( 0 ), frameCount( 0 ) { }
+
+	int init( int width, int height );
+	void update( );
+	void dispatch( ) { }
+	void close( );
+	int isExit( ) { return 0; }
+	uint32* getFrameBuffer( );
+
+	int savePPM( const char* path );
+	inline int getFrameCount( ) { return frameCount; }
+
+private:
+	uint32* framebuffer;
+	int width;
+	int height;
+	int frameCount;
+};
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "Profiler.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* STAGE_NAMES[PROFILE_STAGES] = { "vertex", "clip", "setup", "raster", "shade", "output", "light" };
+static const char* COUNTER_NAMES[PROFILE_COUNTERS] = {
+	"triangles", "backface_culled", "cvv_rejected", "clipped", "pixels_tested", "pixels_shaded", "overdraw", "lights_shaded"
+};
+
+Profiler& Profiler::get( )
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::Profiler( ) : epoch( std::chrono::steady_clock::now( ) ), frameStart( 0 ), traceEnabled( false )
+{
+}
+
+Profiler::~Profiler( )
+{
+	for ( size_t i = 0; i < threads.size( ); i ++ ) delete threads[i];
+}
+
+ProfileThread* Profiler::registerThread( )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+
+	// threads are never unregistered, a pool that is torn down leaves its zeroed slots behind
+	ProfileThread* t = new ProfileThread( );
+	memset( t->stageNs, 0, sizeof( t->stageNs ) );
+	memset( t->counters, 0, sizeof( t->counters ) );
+	t->tid = ( int )threads.size( );
+	t->current = NULL;
+	threads.push_back( t );
+	return t;
+}
+
+void Profiler::endFrame( )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+
+	ProfileFrame frame;
+	memset( &frame, 0, sizeof( frame ) );
+	long long end = now( );
+	frame.frameNs = end - frameStart;
+
+	for ( size_t i = 0; i < threads.size( ); i ++ )
+	{
+		ProfileThread* t = threads[i];
+		for ( int s = 0; s < PROFILE_STAGES; s ++ ) frame.stageNs[s] += t->stageNs[s];
+		for ( int c = 0; c < PROFILE_COUNTERS; c ++ ) frame.counters[c] += t->counters[c];
+		memset( t->stageNs, 0, sizeof( t->stageNs ) );
+		memset( t->counters, 0, sizeof( t->counters ) );
+	}
+
+	if ( traceEnabled ) frameEvents.push_back( { PROFILE_STAGES, 0, frameStart, frame.frameNs } );
+	frames.push_back( frame );
+	frameStart = end;
+}
+
+void Profiler::reset( )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+
+	for ( size_t i = 0; i < threads.size( ); i ++ )
+	{
+		memset( threads[i]->stageNs, 0, sizeof( threads[i]->stageNs ) );
+		memset( threads[i]->counters, 0, sizeof( threads[i]->counters ) );
+		threads[i]->events.clear( );
+	}
+	frames.clear( );
+	frameEvents.clear( );
+	frameStart = now( );
+}
+
+int Profiler::writeJson( const char* path )
+{
+	FILE* fp = fopen( path, "w" );
+	if ( fp == NULL ) return -1;
+
+	fprintf( fp, "{\n\t\"frames\": [\n" );
+	for ( size_t i = 0; i < frames.size( ); i ++ )
+	{
+		const ProfileFrame& f = frames[i];
+		fprintf( fp, "\t\t{ \"frame\": %d, \"ms\": %.4f, \"stages_ms\": { ", ( int )i, f.frameNs * 1e-6 );
+		for ( int s = 0; s < PROFILE_STAGES; s ++ )
+		{
+			fprintf( fp, "%s\"%s\": %.4f", s ? ", " : "", STAGE_NAMES[s], f.stageNs[s] * 1e-6 );
+		}
+		fprintf( fp, " }, \"counters\": { " );
+		for ( int c = 0; c < PROFILE_COUNTERS; c ++ )
+		{
+			fprintf( fp, "%s\"%s\": %lld", c ? ", " : "", COUNTER_NAMES[c], f.counters[c] );
+		}
+		fprintf( fp, " } }%s\n", i + 1 < frames.size( ) ? "," : "" );
+	}
+	fprintf( fp, "\t]\n}\n" );
+	fclose( fp );
+
+	return 0;
+}
+
+int Profiler::writeChromeTrace( const char* path )
+{
+	FILE* fp = fopen( path, "w" );
+	if ( fp == NULL ) return -1;
+
+	// chrome://tracing and perfetto read complete ( "X" ) events with microsecond timestamps
+	bool first = true;
+	fprintf( fp, "{ \"traceEvents\": [\n" );
+	for ( size_t i = 0; i <= threads.size( ); i ++ )
+	{
+		const std::vector<ProfileEvent>& events = i < threads.size( ) ? threads[i]->events : frameEvents;
+		for ( size_t e = 0; e < events.size( ); e ++ )
+		{
+			const ProfileEvent& ev = events[e];
+			fprintf( fp, "%s\t{ \"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f }",
+				first ? "" : ",\n", ev.stage < PROFILE_STAGES ? STAGE_NAMES[ev.stage] : "frame",
+				ev.stage < PROFILE_STAGES ? ev.tid : -1, ev.startNs * 1e-3, ev.durationNs * 1e-3 );
+			first = false;
+		}
+	}
+	fprintf( fp, "\n] }\n" );
+	fclose( fp );
+
+	return 0;
+}
\ No newline at end of file
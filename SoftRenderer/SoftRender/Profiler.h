@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stddef.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// per stage frame profiler and pipeline counters. the PROFILE_* macros below are the only way the pipeline
+// touches it, and they expand to nothing unless SOFTRENDER_PROFILE is defined
+
+enum ProfileStage
+{
+	PROFILE_VERTEX, PROFILE_CLIP, PROFILE_SETUP, PROFILE_RASTER, PROFILE_SHADE, PROFILE_OUTPUT, PROFILE_LIGHT, PROFILE_STAGES
+};
+
+enum ProfileCounter
+{
+	PROFILE_TRIANGLES,			// triangles submitted after vertex processing
+	PROFILE_BACKFACE,			// back facing or degenerate after snapping
+	PROFILE_CVV_REJECTED,		// all three vertices outside one clip plane
+	PROFILE_CLIPPED,			// split on the near plane or the guard band
+	PROFILE_PIXELS_TESTED,		// covered pixels that reached the depth test
+	PROFILE_PIXELS_SHADED,		// pixels that passed it and were written
+	PROFILE_OVERDRAW,			// written pixels that had already been written this frame
+	PROFILE_LIGHTS_SHADED,		// point lights left after tile culling, summed over the deferred light tiles
+	PROFILE_COUNTERS
+};
+
+struct ProfileFrame
+{
+	long long	frameNs;
+	long long	stageNs[PROFILE_STAGES];	// exclusive time summed over all threads
+	long long	counters[PROFILE_COUNTERS];
+};
+
+struct ProfileEvent
+{
+	int			stage;		// PROFILE_STAGES marks a whole frame
+	int			tid;
+	long long	startNs;
+	long long	durationNs;
+};
+
+class ProfileScope;
+
+// one per thread that ever entered a scope, written only by its own thread
+struct ProfileThread
+{
+	int							tid;
+	long long					stageNs[PROFILE_STAGES];
+	long long					counters[PROFILE_COUNTERS];
+	ProfileScope*				current;
+	std::vector<ProfileEvent>	events;
+};
+
+class Profiler
+{
+public:
+	static Profiler&	get( );
+
+	// folds every thread's stage times and counters into a new frame, called from Device::present
+	// while the workers are idle
+	void	endFrame( );
+	void	reset( );
+
+	// record individual vertex and raster tile scopes for writeChromeTrace; off by default
+	inline void	setTraceEnabled( bool enable ) { traceEnabled = enable; }
+	inline bool	isTraceEnabled( ) const { return traceEnabled; }
+
+	int		writeJson( const char* path );
+	int		writeChromeTrace( const char* path );
+
+	inline const std::vector<ProfileFrame>&	getFrames( ) const { return frames; }
+	inline long long	now( ) const { return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now( ) - epoch ).count( ); }
+
+	ProfileThread*	registerThread( );
+
+private:
+	Profiler( );
+	~Profiler( );
+	Profiler( const Profiler& );
+	Profiler& operator = ( const Profiler& );
+
+	std::mutex							mutex;
+	std::vector<ProfileThread*>			threads;
+	std::vector<ProfileFrame>			frames;
+	std::vector<ProfileEvent>			frameEvents;
+	std::chrono::steady_clock::time_point	epoch;
+	long long							frameStart;
+	bool								traceEnabled;
+};
+
+inline ProfileThread* ProfileLocalThread( )
+{
+	static thread_local ProfileThread* local = NULL;
+	if ( local == NULL ) local = Profiler::get( ).registerThread( );
+	return local;
+}
+
+// times its enclosing block for one stage; nested scopes are subtracted, so every stage reports exclusive time
+class ProfileScope
+{
+public:
+	inline ProfileScope( ProfileStage s ) : stage( s ), childNs( 0 )
+	{
+		thread = ProfileLocalThread( );
+		parent = thread->current;
+		thread->current = this;
+		start = Profiler::get( ).now( );
+	}
+
+	inline ~ProfileScope( )
+	{
+		Profiler& profiler = Profiler::get( );
+		long long duration = profiler.now( ) - start;
+		thread->stageNs[stage] += duration - childNs;
+		thread->current = parent;
+		if ( parent != NULL ) parent->childNs += duration;
+
+		// only the coarse stages go to the trace, per quad events would swamp it
+		if ( profiler.isTraceEnabled( ) && ( stage == PROFILE_VERTEX || stage == PROFILE_RASTER || stage == PROFILE_LIGHT ) )
+		{
+			thread->events.push_back( { stage, thread->tid, start, duration } );
+		}
+	}
+
+private:
+	ProfileStage	stage;
+	ProfileThread*	thread;
+	ProfileScope*	parent;
+	long long		start;
+	long long		childNs;
+};
+
+#ifdef SOFTRENDER_PROFILE
+#define PROFILE_CONCAT2( a, b )		a##b
+#define PROFILE_CONCAT( a, b )		PROFILE_CONCAT2( a, b )
+#define PROFILE_SCOPE( stage )		ProfileScope PROFILE_CONCAT( profileScope, __LINE__ )( stage )
+#define PROFILE_COUNT( counter, n )	( ProfileLocalThread( )->counters[counter] += ( n ) )
+#define PROFILE_END_FRAME( )		Profiler::get( ).endFrame( )
+#else
+#define PROFILE_SCOPE( stage )
+#define PROFILE_COUNT( counter, n )
+#define PROFILE_END_FRAME( )
+#endif
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "Scene.h"
+#include "Mesh.h"
+#include "Device.h"
+#include "Transform.h"
+#include "VertexFormat.h"
+
+static const int LEAF_SIZE = 4;
+static const float PI = 3.1415926f;
+
+enum { CULL_OUTSIDE, CULL_INTERSECT, CULL_INSIDE };
+
+void InitSceneMesh( SceneMesh& mesh, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount )
+{
+	mesh.lods[0].vertices = vertices;
+	mesh.lods[0].vertexCount = vertexCount;
+	mesh.lods[0].indices = indices;
+	mesh.lods[0].indexCount = indexCount;
+	mesh.lods[0].packed = NULL;
+	mesh.lodCount = 1;
+	ComputeMeshBounds( mesh.min, mesh.max, vertices, vertexCount );
+}
+
+void InitSceneMesh( SceneMesh& mesh, const PackedMesh& packed )
+{
+	mesh.lods[0] = { NULL, packed.vertexCount, NULL, packed.indexCount, &packed };
+	mesh.lodCount = 1;
+	ComputeMeshBounds( mesh.min, mesh.max, packed );
+}
+
+int AddSceneMeshLod( SceneMesh& mesh, const Mesh& lod )
+{
+	if ( mesh.lodCount >= SceneMesh::MAX_LODS ) return -1;
+	SceneLod& l = mesh.lods[mesh.lodCount];
+	l.vertices = lod.vertices.data( );
+	l.vertexCount = ( int )lod.vertices.size( );
+	l.indices = lod.indices.data( );
+	l.indexCount = ( int )lod.indices.size( );
+	l.packed = NULL;
+	return mesh.lodCount ++;
+}
+
+int AddSceneMeshLod( SceneMesh& mesh, const PackedMesh& lod )
+{
+	if ( mesh.lodCount >= SceneMesh::MAX_LODS ) return -1;
+	mesh.lods[mesh.lodCount] = { NULL, lod.vertexCount, NULL, lod.indexCount, &lod };
+	return mesh.lodCount ++;
+}
+
+// world box of a transformed object box: the center is transformed, the half extents go through the absolute
+// values of the upper 3x3
+static void TransformBounds( SceneInstance& instance )
+{
+	const SceneMesh& mesh = *instance.mesh;
+	const float( *m )[4] = instance.world.m;
+	float c[3] = { ( mesh.min.x + mesh.max.x ) * 0.5f, ( mesh.min.y + mesh.max.y ) * 0.5f, ( mesh.min.z + mesh.max.z ) * 0.5f };
+	float e[3] = { ( mesh.max.x - mesh.min.x ) * 0.5f, ( mesh.max.y - mesh.min.y ) * 0.5f, ( mesh.max.z - mesh.min.z ) * 0.5f };
+
+	float wc[3], we[3];
+	for ( int j = 0; j < 3; j ++ )
+	{
+		wc[j] = c[0] * m[0][j] + c[1] * m[1][j] + c[2] * m[2][j] + m[3][j];
+		we[j] = e[0] * fabsf( m[0][j] ) + e[1] * fabsf( m[1][j] ) + e[2] * fabsf( m[2][j] );
+	}
+
+	instance.min = { wc[0] - we[0], wc[1] - we[1], wc[2] - we[2], 1.f };
+	instance.max = { wc[0] + we[0], wc[1] + we[1], wc[2] + we[2], 1.f };
+	instance.center = { wc[0], wc[1], wc[2], 1.f };
+	instance.radius = sqrtf( we[0] * we[0] + we[1] * we[1] + we[2] * we[2] );
+}
+
+static inline void GrowBounds( Vector& min, Vector& max, const Vector& bmin, const Vector& bmax )
+{
+	min.x = std::min( min.x, bmin.x );
+	min.y = std::min( min.y, bmin.y );
+	min.z = std::min( min.z, bmin.z );
+	max.x = std::max( max.x, bmax.x );
+	max.y = std::max( max.y, bmax.y );
+	max.z = std::max( max.z, bmax.z );
+}
+
+// world space planes of the view volume, inside where x * p.x + y * p.y + z * p.z + w >= 0; with row vectors
+// a clip coordinate is a column of the view-projection matrix, so each plane is a sum of two columns
+static void ExtractFrustum( Vector* planes, const Matrix& vp )
+{
+	const float( *m )[4] = vp.m;
+	Vector col[4];
+	for ( int j = 0; j < 4; j ++ ) col[j] = { m[0][j], m[1][j], m[2][j], m[3][j] };
+
+	// near z >= 0, far w - z >= 0, then w + x, w - x, w + y, w - y >= 0
+	const int axis[6] = { 2, 2, 0, 0, 1, 1 };
+	const float sign[6] = { 1.f, -1.f, 1.f, -1.f, 1.f, -1.f };
+	for ( int i = 0; i < 6; i ++ )
+	{
+		const Vector& c = col[axis[i]];
+		float w = i == 0 ? 0.f : 1.f;
+		Vector p = { w * col[3].x + sign[i] * c.x, w * col[3].y + sign[i] * c.y, w * col[3].z + sign[i] * c.z, w * col[3].w + sign[i] * c.w };
+
+		float len = sqrtf( p.x * p.x + p.y * p.y + p.z * p.z );
+		if ( len > 0.f ) p /= len;
+		planes[i] = p;
+	}
+}
+
+static int CullBox( const Vector* planes, const Vector& min, const Vector& max )
+{
+	int result = CULL_INSIDE;
+	for ( int i = 0; i < 6; i ++ )
+	{
+		const Vector& p = planes[i];
+		// corner furthest along the plane normal, and the one furthest against it
+		float outer = p.x * ( p.x >= 0.f ? max.x : min.x ) + p.y * ( p.y >= 0.f ? max.y : min.y ) + p.z * ( p.z >= 0.f ? max.z : min.z ) + p.w;
+		if ( outer < 0.f ) return CULL_OUTSIDE;
+		float inner = p.x * ( p.x >= 0.f ? min.x : max.x ) + p.y * ( p.y >= 0.f ? min.y : max.y ) + p.z * ( p.z >= 0.f ? min.z : max.z ) + p.w;
+		if ( inner < 0.f ) result = CULL_INTERSECT;
+	}
+	return result;
+}
+
+static bool CullSphere( const Vector* planes, const Vector& center, float radius )
+{
+	for ( int i = 0; i < 6; i ++ )
+	{
+		const Vector& p = planes[i];
+		if ( p.x * center.x + p.y * center.y + p.z * center.z + p.w < - radius ) return true;
+	}
+	return false;
+}
+
+int Scene::addInstance( const SceneMesh* mesh, const Matrix& world )
+{
+	SceneInstance instance;
+	instance.mesh = mesh;
+	instance.world = world;
+	TransformBounds( instance );
+	instances.push_back( instance );
+	rebuild = true;
+	return ( int )instances.size( ) - 1;
+}
+
+void Scene::setWorld( int instance, const Matrix& world )
+{
+	instances[instance].world = world;
+	TransformBounds( instances[instance] );
+	refit = true;
+}
+
+void Scene::clear( )
+{
+	instances.clear( );
+	order.clear( );
+	nodes.clear( );
+	rebuild = false;
+	refit = false;
+}
+
+void Scene::build( )
+{
+	if ( rebuild )
+	{
+		int count = ( int )instances.size( );
+		order.resize( count );
+		for ( int i = 0; i < count; i ++ ) order[i] = i;
+
+		nodes.clear( );
+		nodes.reserve( 2 * ( count / LEAF_SIZE + 1 ) );
+		if ( count > 0 )
+		{
+			nodes.emplace_back( );
+			buildNode( 0, 0, count );
+		}
+	}
+	else if ( refit )
+	{
+		// children are stored after their parent, so a reverse sweep sees every child before its parent
+		for ( int n = ( int )nodes.size( ) - 1; n >= 0; n -- )
+		{
+			Node& node = nodes[n];
+			if ( node.count > 0 )
+			{
+				node.min = instances[order[node.first]].min;
+				node.max = instances[order[node.first]].max;
+				for ( int i = 1; i < node.count; i ++ )
+				{
+					GrowBounds( node.min, node.max, instances[order[node.first + i]].min, instances[order[node.first + i]].max );
+				}
+			}
+			else
+			{
+				node.min = nodes[node.first].min;
+				node.max = nodes[node.first].max;
+				GrowBounds( node.min, node.max, nodes[node.first + 1].min, nodes[node.first + 1].max );
+			}
+		}
+	}
+	rebuild = false;
+	refit = false;
+}
+
+void Scene::buildNode( int node, int first, int count )
+{
+	Vector min = instances[order[first]].min, max = instances[order[first]].max;
+	Vector cmin = instances[order[first]].center, cmax = cmin;
+	for ( int i = 1; i < count; i ++ )
+	{
+		const SceneInstance& instance = instances[order[first + i]];
+		GrowBounds( min, max, instance.min, instance.max );
+		GrowBounds( cmin, cmax, instance.center, instance.center );
+	}
+	nodes[node].min = min;
+	nodes[node].max = max;
+
+	// median split of the centers along the longest axis of their bounds
+	float ext[3] = { cmax.x - cmin.x, cmax.y - cmin.y, cmax.z - cmin.z };
+	int axis = ext[0] >= ext[1] && ext[0] >= ext[2] ? 0 : ext[1] >= ext[2] ? 1 : 2;
+	if ( count <= LEAF_SIZE || ext[axis] <= 0.f )
+	{
+		nodes[node].first = first;
+		nodes[node].count = count;
+		return;
+	}
+
+	int half = count / 2;
+	std::nth_element( order.begin( ) + first, order.begin( ) + first + half, order.begin( ) + first + count,
+		[this, axis]( int a, int b ) { return ( &instances[a].center.x )[axis] < ( &instances[b].center.x )[axis]; } );
+
+	int left = ( int )nodes.size( );
+	nodes.emplace_back( );
+	nodes.emplace_back( );
+	nodes[node].first = left;
+	nodes[node].count = 0;
+	buildNode( left, first, half );
+	buildNode( left + 1, first + half, count - half );
+}
+
+void Scene::draw( Device* device, Transform* transform )
+{
+	build( );
+
+	visibleCount = 0;
+	nodesVisited = 0;
+	trianglesDrawn = 0;
+	if ( nodes.empty( ) ) return;
+
+	Matrix vp;
+	transform->getViewProjection( vp );
+	Vector planes[6];
+	ExtractFrustum( planes, vp );
+
+	drawNode( 0, false, planes, device, transform );
+}
+
+void Scene::drawNode( int node, bool inside, const Vector* planes, Device* device, Transform* transform )
+{
+	const Node& n = nodes[node];
+	nodesVisited ++;
+
+	// a subtree entirely inside the frustum is drawn without testing anything below it
+	if ( !inside )
+	{
+		int cull = CullBox( planes, n.min, n.max );
+		if ( cull == CULL_OUTSIDE ) return;
+		inside = cull == CULL_INSIDE;
+	}
+
+	if ( n.count == 0 )
+	{
+		drawNode( n.first, inside, planes, device, transform );
+		drawNode( n.first + 1, inside, planes, device, transform );
+		return;
+	}
+
+	for ( int i = 0; i < n.count; i ++ )
+	{
+		const SceneInstance& instance = instances[order[n.first + i]];
+		if ( !inside && ( CullSphere( planes, instance.center, instance.radius ) ||
+			CullBox( planes, instance.min, instance.max ) == CULL_OUTSIDE ) ) continue;
+		drawInstance( instance, device, transform );
+	}
+}
+
+void Scene::drawInstance( const SceneInstance& instance, Device* device, Transform* transform )
+{
+	const SceneMesh& mesh = *instance.mesh;
+	int level = 0;
+	if ( mesh.lodCount > 1 && lodPixelsPerTriangle > 0.f )
+	{
+		float r = transform->projectedRadius( instance.center, instance.radius );
+		float budget = PI * r * r / lodPixelsPerTriangle;
+		while ( level + 1 < mesh.lodCount && mesh.lods[level].indexCount / 3 > budget ) level ++;
+	}
+
+	const SceneLod& lod = mesh.lods[level];
+	transform->setWorld( instance.world );
+	transform->update( );
+	if ( lod.packed != NULL )
+		device->drawMesh( *lod.packed );
+	else
+		device->drawMesh( lod.vertices, lod.vertexCount, lod.indices, lod.indexCount );
+	visibleCount ++;
+	trianglesDrawn += lod.indexCount / 3;
+}
\ No newline at end of file
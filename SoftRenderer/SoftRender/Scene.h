@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Config.h"
+#include "math.h"
+#include "Vertex.h"
+#include <vector>
+
+class Device;
+class Transform;
+
+struct Mesh;
+struct PackedMesh;
+
+// a level is drawn from packed when that is set, from vertices and indices otherwise
+struct SceneLod
+{
+	const Vertex*		vertices;
+	int					vertexCount;
+	const uint32*		indices;
+	int					indexCount;
+	const PackedMesh*	packed;
+};
+
+// geometry shared by any number of instances, with its object space bounds computed once. lods[0] is the
+// full mesh, every further level a coarser version of it ( see BuildMeshLods )
+struct SceneMesh
+{
+	enum { MAX_LODS = 8 };
+
+	SceneLod		lods[MAX_LODS];
+	int				lodCount;
+	Vector			min;
+	Vector			max;
+};
+
+void	InitSceneMesh( SceneMesh& mesh, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount );
+void	InitSceneMesh( SceneMesh& mesh, const PackedMesh& packed );
+// appends a coarser level, which has to outlive the mesh; returns -1 once all MAX_LODS are in use
+int		AddSceneMeshLod( SceneMesh& mesh, const Mesh& lod );
+int		AddSceneMeshLod( SceneMesh& mesh, const PackedMesh& lod );
+
+struct SceneInstance
+{
+	const SceneMesh*	mesh;
+	Matrix				world;
+	Vector				min;		// world space box around the transformed object box
+	Vector				max;
+	Vector				center;		// world space bounding sphere of that box
+	float				radius;
+};
+
+// mesh instances with their own world matrices under a bounding volume hierarchy of their world space boxes;
+// draw( ) culls whole subtrees against the view frustum before any of their vertices is transformed
+class Scene
+{
+public:
+	inline Scene( ) : lodPixelsPerTriangle( 1.f ), rebuild( false ), refit( false ), visibleCount( 0 ), nodesVisited( 0 ),
+		trianglesDrawn( 0 ) { }
+
+	int		addInstance( const SceneMesh* mesh, const Matrix& world );
+	void	setWorld( int instance, const Matrix& world );
+	void	clear( );
+
+	// brings the hierarchy up to date: a full rebuild after instances were added, a bottom-up refit of the
+	// node boxes when they only moved; draw( ) calls it itself
+	void	build( );
+	void	draw( Device* device, Transform* transform );
+
+	// an instance draws the finest level with at most one triangle per that many pixels of its projected
+	// bounding circle, or the coarsest one; 0 always draws lods[0]
+	inline void	setLodPixelsPerTriangle( float pixels ) { lodPixelsPerTriangle = pixels; }
+
+	inline int	getInstanceCount( ) const { return ( int )instances.size( ); }
+	inline int	getVisibleCount( ) const { return visibleCount; }
+	inline int	getNodesVisited( ) const { return nodesVisited; }
+	inline int	getTrianglesDrawn( ) const { return trianglesDrawn; }
+
+private:
+	struct Node
+	{
+		Vector	min;
+		Vector	max;
+		int		first;	// leaf: first entry in order, inner node: index of the left child, the right one follows it
+		int		count;	// instances of a leaf, 0 for inner nodes
+	};
+
+	void	buildNode( int node, int first, int count );
+	void	drawNode( int node, bool inside, const Vector* planes, Device* device, Transform* transform );
+	void	drawInstance( const SceneInstance& instance, Device* device, Transform* transform );
+
+	std::vector<SceneInstance>	instances;
+	std::vector<int>			order;		// instance indices, every leaf owns a contiguous range
+	std::vector<Node>			nodes;		// children always come after their parent
+	float						lodPixelsPerTriangle;
+	bool						rebuild;
+	bool						refit;
+	int							visibleCount;
+	int							nodesVisited;
+	int							trianglesDrawn;
+};
\ No newline at end of file
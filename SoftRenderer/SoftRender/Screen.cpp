@@ -126,7 +126,7 @@ int Screen::isExit( )
 	return Exit;
 }
 
-LPVOID Screen::getFrameBuffer( )
+uint32* Screen::getFrameBuffer( )
 {
-	return wndFramebuffer;
+	return ( uint32* )wndFramebuffer;
 }
\ No newline at end of file
@@ -1,7 +1,8 @@
 #pragma once
 #include <windows.h>
+#include "Display.h"
 
-class Screen
+class Screen : public Display
 {
 public:
 	int init( int width, int height, LPCTSTR title );
@@ -11,7 +12,7 @@ public:
 	int isKeyPressed( int key );
 	int getKeyUpEvent( int key );
 	int isExit( );
-	LPVOID getFrameBuffer( );
+	uint32* getFrameBuffer( );
 
 private:
 	HWND wndHandle;
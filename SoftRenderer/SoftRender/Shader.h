@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Device.h"
+#include "Profiler.h"
+#include <algorithm>
+
+// programmable path of Device, the C++ side of vertex_shader / pixel_shader in lua/shader.lua. a shader is
+// any class providing
+//
+//	typedef ...	Input;		// vertex type read by drawShaded
+//	typedef ...	Varyings;	// plain struct of 1 to Device::MAX_VARYINGS floats
+//	void	vertex( Vector& clip, Varyings& out, const Input& in ) const;
+//	Color	pixel( const Varyings& in ) const;
+//
+// vertex( ) runs once per vertex and returns the clip space position and the varyings. they are clipped and
+// turned into perspective correct plane equations once per triangle, and pixel( ) gets them interpolated for
+// every pixel that passes the depth test. pixel( ) is called from the raster threads, so it may only read
+// the shader and whatever the shader points to
+
+// pixel stage entry handed to the device: evaluates the varying planes at the covered lanes of a group
+template<class Shader>
+void ShadeGroup( const void* context, const float* planes, int x, int y, int mask, uint32* colors )
+{
+	typedef typename Shader::Varyings Varyings;
+	const int count = ( int )( sizeof( Varyings ) / sizeof( float ) );
+	const Shader& shader = *( const Shader* )context;
+
+	Varyings in;
+	float* v = ( float* )&in;
+	float fy = ( float )y;
+	for ( int l = 0; l < SIMD_WIDTH; l ++ )
+	{
+		if ( !( ( mask >> l ) & 1 ) ) continue;
+
+		float fx = ( float )( x + l );
+		float w = 1.f / ( planes[0] * fx + planes[1] * fy + planes[2] );
+		const float* p = planes + 6;
+		for ( int k = 0; k < count; k ++, p += 3 )
+		{
+			v[k] = ( p[0] * fx + p[1] * fy + p[2] ) * w;
+		}
+
+		Color c = shader.pixel( in );
+		int r = ( int )( std::min( std::max( c.r, 0.f ), 1.f ) * 255.f );
+		int g = ( int )( std::min( std::max( c.g, 0.f ), 1.f ) * 255.f );
+		int b = ( int )( std::min( std::max( c.b, 0.f ), 1.f ) * 255.f );
+		colors[l] = ( r << 16 ) | ( g << 8 ) | b;
+	}
+}
+
+template<class Shader>
+void Device::drawShaded( const Shader& shader, const typename Shader::Input* vertices, int vertexCount,
+	const uint32* indices, int indexCount )
+{
+	typedef typename Shader::Varyings Varyings;
+	static_assert( sizeof( Varyings ) % sizeof( float ) == 0 && sizeof( Varyings ) <= MAX_VARYINGS * sizeof( float ),
+		"varyings must be a struct of at most MAX_VARYINGS floats" );
+	const int count = ( int )( sizeof( Varyings ) / sizeof( float ) );
+
+	beginShaded( &shader, &ShadeGroup<Shader>, count );
+
+	shadedVertices.resize( vertexCount );
+	shadedVaryings.resize( ( size_t )vertexCount * count );
+	{
+		PROFILE_SCOPE( PROFILE_VERTEX );
+		for ( int i = 0; i < vertexCount; i ++ )
+		{
+			Vector clip;
+			shader.vertex( clip, *( Varyings* )&shadedVaryings[( size_t )i * count], vertices[i] );
+			projectVertex( shadedVertices[i], clip );
+		}
+	}
+
+	for ( int i = 0; i + 2 < indexCount; i += 3 )
+	{
+		uint32 i1 = indices[i], i2 = indices[i + 1], i3 = indices[i + 2];
+		if ( i1 >= ( uint32 )vertexCount || i2 >= ( uint32 )vertexCount || i3 >= ( uint32 )vertexCount ) continue;
+
+		submitShaded( shadedVertices[i1], shadedVertices[i2], shadedVertices[i3],
+			&shadedVaryings[( size_t )i1 * count], &shadedVaryings[( size_t )i2 * count], &shadedVaryings[( size_t )i3 * count] );
+	}
+
+	endShaded( );
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "ShadowMap.h"
+#include "Device.h"
+#include "Transform.h"
+#include <math.h>
+
+// texels of depth slope the bias allows for, the map is sampled up to two texels away from the point
+static const float BIAS_TEXELS = 2.f;
+
+int ShadowMap::init( int s, int threadCount )
+{
+	close( );
+
+	if ( s <= 0 ) return -1;
+	colorBuffer = ( uint32* )malloc( s * s * sizeof( uint32 ) );
+	if ( colorBuffer == NULL ) return -2;
+
+	size = s;
+	transform = new Transform( );
+	transform->init( s, s );
+
+	// every texel is written by clear( ), so the depth buffer never holds a stale logically cleared tile
+	device = new Device( );
+	device->init( s, s, colorBuffer, transform, NULL, NULL, IlluminationMode::COLOR );
+	device->setThreadCount( threadCount );
+	device->setFastClear( false );
+	device->setDepthOnly( true );
+	return 0;
+}
+
+void ShadowMap::close( )
+{
+	if ( device != NULL )
+	{
+		device->close( );
+		delete device;
+		device = NULL;
+	}
+	if ( transform != NULL )
+	{
+		delete transform;
+		transform = NULL;
+	}
+	if ( colorBuffer != NULL )
+	{
+		free( colorBuffer );
+		colorBuffer = NULL;
+	}
+	size = 0;
+}
+
+void ShadowMap::setDepthFormat( DepthFormat format )
+{
+	device->setDepthFormat( format );
+}
+
+void ShadowMap::begin( const Vector& direction, const Vector& center, float radius )
+{
+	Vector dir = direction;
+	VectorNormalize( dir );
+
+	// the eye sits on the sphere towards the light, so the depth range is exactly its diameter
+	Vector eye = { center.x - dir.x * radius, center.y - dir.y * radius, center.z - dir.z * radius, 1.f };
+	Vector up = fabsf( dir.z ) < 0.9f ? Vector { 0.f, 0.f, 1.f, 0.f } : Vector { 1.f, 0.f, 0.f, 0.f };
+	Matrix view, projection;
+	MatrixSetLookAt( view, eye, center, up );
+	bool reversed = device->getDepthFormat( ) == DepthFormat::FLOAT32_REVERSED;
+	MatrixSetOrthographic( projection, 2.f * radius, 2.f * radius, reversed ? 2.f * radius : 0.f, reversed ? 0.f : 2.f * radius );
+	transform->setView( view );
+	transform->setProjection( projection );
+	transform->getViewProjection( lightViewProjection );
+
+	// a texel spans 2 * radius / size across and the depth range 2 * radius, so this is BIAS_TEXELS texels of a
+	// surface at 45 degrees to the light
+	bias = BIAS_TEXELS / size * fabsf( device->getDepthKey( 1.f ) );
+	farDepth = device->getDepthKey( reversed ? 0.f : 1.f );
+	device->clear( );
+}
+
+void ShadowMap::drawMesh( const Matrix& world, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount )
+{
+	transform->setWorld( world );
+	transform->update( );
+	device->drawMesh( vertices, vertexCount, indices, indexCount );
+}
+
+void ShadowMap::drawMesh( const Matrix& world, const PackedMesh& mesh )
+{
+	transform->setWorld( world );
+	transform->update( );
+	device->drawMesh( mesh );
+}
+
+void ShadowMap::end( )
+{
+	device->present( );
+}
+
+void ShadowMap::project( Vector& m, const Vector& pos ) const
+{
+	Vector clip;
+	MatrixApply( clip, { pos.x, pos.y, pos.z, 1.f }, lightViewProjection );
+	m.x = ( clip.x + 1.f ) * size * 0.5f;
+	m.y = ( 1.f - clip.y ) * size * 0.5f;
+	m.z = clip.z;
+	m.w = 1.f;
+}
+
+float ShadowMap::lookup( const Vector& m ) const
+{
+	float z = device->getDepthKey( m.z );
+	if ( !( m.x >= 0.f && m.y >= 0.f && m.x < size && m.y < size && z <= farDepth ) ) return 1.f;
+
+	// 3x3 bilinear PCF taps one texel apart cover a 4x4 texel footprint, each texel weighted by how many taps
+	// reach it: 1 - fx, 1, 1, fx along x and the same along y, 9 in total
+	int x = ( int )m.x, y = ( int )m.y;
+	float fx = m.x - x, fy = m.y - y;
+	float wx[4] = { 1.f - fx, 1.f, 1.f, fx };
+	float wy[4] = { 1.f - fy, 1.f, 1.f, fy };
+	z -= bias;
+
+	float lit = 0.f;
+	for ( int j = 0; j < 4; j ++ )
+	{
+		int ty = std::min( std::max( y - 1 + j, 0 ), size - 1 );
+		float rowLit = 0.f;
+		for ( int i = 0; i < 4; i ++ )
+		{
+			int tx = std::min( std::max( x - 1 + i, 0 ), size - 1 );
+			if ( z <= device->getDepth( tx, ty ) ) rowLit += wx[i];
+		}
+		lit += rowLit * wy[j];
+	}
+	return lit * ( 1.f / 9.f );
+}
\ No newline at end of file
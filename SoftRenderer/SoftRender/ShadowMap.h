@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Config.h"
+#include "math.h"
+#include "Vertex.h"
+
+class Device;
+class Transform;
+struct PackedMesh;
+enum class DepthFormat;
+
+// depth of the scene seen along a directional light, rendered with an orthographic projection through a depth
+// only Device; the lighting of every Device whose Light::shadow points here scales that light by lookup( )
+class ShadowMap
+{
+public:
+	inline ShadowMap( ) : device( NULL ), transform( NULL ), colorBuffer( NULL ), size( 0 ), bias( 0.f ), farDepth( 0.f ) { }
+	inline ~ShadowMap( ) { close( ); }
+
+	int		init( int size, int threadCount );
+	void	close( );
+	// format of the map, Device::setDepthFormat of its Device; takes effect with the next begin( )
+	void	setDepthFormat( DepthFormat format );
+
+	// fits the light view around a world space sphere holding every caster and receiver and clears the map;
+	// casters are drawn in between, and the map can be sampled once end( ) returns
+	void	begin( const Vector& direction, const Vector& center, float radius );
+	void	drawMesh( const Matrix& world, const Vertex* vertices, int vertexCount, const uint32* indices, int indexCount );
+	void	drawMesh( const Matrix& world, const PackedMesh& mesh );
+	void	end( );
+
+	// world space point to map texels in x and y ( texel centers on integers, like pixels ) and map depth in z
+	void	project( Vector& m, const Vector& pos ) const;
+	// fraction of the light that reaches a point given by project( ), 1 outside the map
+	float	lookup( const Vector& m ) const;
+
+	inline int	getSize( ) const { return size; }
+
+private:
+	ShadowMap( const ShadowMap& );
+	ShadowMap& operator = ( const ShadowMap& );
+
+	Device*			device;
+	Transform*		transform;
+	uint32*			colorBuffer;	// the Device needs one, depth only drawing just clears it
+	Matrix			lightViewProjection;
+	int				size;
+	float			bias;			// depth key a receiver may lie behind its own texel, against self shadowing
+	float			farDepth;		// depth key of the far plane, receivers beyond it are lit
+};
\ No newline at end of file
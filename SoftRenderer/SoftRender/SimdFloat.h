@@ -0,0 +1,109 @@
+#pragma once
+
+// SIMD_WIDTH floats processed in lock step: 8 lanes with AVX, 4 lanes with SSE2, and a
+// plain 4 lane array when neither is available, so the same code builds everywhere.
+// vconvert loads SIMD_WIDTH ints as float values, vloadbits reinterprets their bits as floats,
+// vround rounds to the nearest integer ( ties to even ) and is only exact below 2^31
+
+#if defined( __AVX__ )
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#define SIMD_AVX
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#define SIMD_SSE
+#else
+#define SIMD_WIDTH 4
+#endif
+
+#if defined( SIMD_AVX )
+
+struct vfloat { __m256 v; };
+struct vmask { __m256 v; };
+
+inline vfloat	vset1( float f ) { return { _mm256_set1_ps( f ) }; }
+inline vfloat	vramp( ) { return { _mm256_setr_ps( 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f ) }; }
+inline vfloat	vload( const float* p ) { return { _mm256_loadu_ps( p ) }; }
+inline vfloat	vconvert( const int* p ) { return { _mm256_cvtepi32_ps( _mm256_loadu_si256( ( const __m256i* )p ) ) }; }
+inline vfloat	vloadbits( const int* p ) { return { _mm256_castsi256_ps( _mm256_loadu_si256( ( const __m256i* )p ) ) }; }
+inline void		vstore( float* p, vfloat a ) { _mm256_storeu_ps( p, a.v ); }
+inline vfloat	operator + ( vfloat a, vfloat b ) { return { _mm256_add_ps( a.v, b.v ) }; }
+inline vfloat	operator - ( vfloat a, vfloat b ) { return { _mm256_sub_ps( a.v, b.v ) }; }
+inline vfloat	operator * ( vfloat a, vfloat b ) { return { _mm256_mul_ps( a.v, b.v ) }; }
+inline vfloat	operator / ( vfloat a, vfloat b ) { return { _mm256_div_ps( a.v, b.v ) }; }
+inline vfloat	vmin( vfloat a, vfloat b ) { return { _mm256_min_ps( a.v, b.v ) }; }
+inline vfloat	vmax( vfloat a, vfloat b ) { return { _mm256_max_ps( a.v, b.v ) }; }
+inline vfloat	vrsqrt_approx( vfloat a ) { return { _mm256_rsqrt_ps( a.v ) }; }
+inline vfloat	vround( vfloat a ) { return { _mm256_round_ps( a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC ) }; }
+inline vmask	operator >= ( vfloat a, vfloat b ) { return { _mm256_cmp_ps( a.v, b.v, _CMP_GE_OQ ) }; }
+inline vmask	operator <= ( vfloat a, vfloat b ) { return { _mm256_cmp_ps( a.v, b.v, _CMP_LE_OQ ) }; }
+inline vmask	operator & ( vmask a, vmask b ) { return { _mm256_and_ps( a.v, b.v ) }; }
+inline vfloat	vselect( vmask m, vfloat a, vfloat b ) { return { _mm256_blendv_ps( b.v, a.v, m.v ) }; }
+inline int		vmovemask( vmask m ) { return _mm256_movemask_ps( m.v ); }
+
+#elif defined( SIMD_SSE )
+
+struct vfloat { __m128 v; };
+struct vmask { __m128 v; };
+
+inline vfloat	vset1( float f ) { return { _mm_set1_ps( f ) }; }
+inline vfloat	vramp( ) { return { _mm_setr_ps( 0.f, 1.f, 2.f, 3.f ) }; }
+inline vfloat	vload( const float* p ) { return { _mm_loadu_ps( p ) }; }
+inline vfloat	vconvert( const int* p ) { return { _mm_cvtepi32_ps( _mm_loadu_si128( ( const __m128i* )p ) ) }; }
+inline vfloat	vloadbits( const int* p ) { return { _mm_castsi128_ps( _mm_loadu_si128( ( const __m128i* )p ) ) }; }
+inline void		vstore( float* p, vfloat a ) { _mm_storeu_ps( p, a.v ); }
+inline vfloat	operator + ( vfloat a, vfloat b ) { return { _mm_add_ps( a.v, b.v ) }; }
+inline vfloat	operator - ( vfloat a, vfloat b ) { return { _mm_sub_ps( a.v, b.v ) }; }
+inline vfloat	operator * ( vfloat a, vfloat b ) { return { _mm_mul_ps( a.v, b.v ) }; }
+inline vfloat	operator / ( vfloat a, vfloat b ) { return { _mm_div_ps( a.v, b.v ) }; }
+inline vfloat	vmin( vfloat a, vfloat b ) { return { _mm_min_ps( a.v, b.v ) }; }
+inline vfloat	vmax( vfloat a, vfloat b ) { return { _mm_max_ps( a.v, b.v ) }; }
+inline vfloat	vrsqrt_approx( vfloat a ) { return { _mm_rsqrt_ps( a.v ) }; }
+inline vfloat	vround( vfloat a ) { return { _mm_cvtepi32_ps( _mm_cvtps_epi32( a.v ) ) }; }
+inline vmask	operator >= ( vfloat a, vfloat b ) { return { _mm_cmpge_ps( a.v, b.v ) }; }
+inline vmask	operator <= ( vfloat a, vfloat b ) { return { _mm_cmple_ps( a.v, b.v ) }; }
+inline vmask	operator & ( vmask a, vmask b ) { return { _mm_and_ps( a.v, b.v ) }; }
+inline vfloat	vselect( vmask m, vfloat a, vfloat b ) { return { _mm_or_ps( _mm_and_ps( m.v, a.v ), _mm_andnot_ps( m.v, b.v ) ) }; }
+inline int		vmovemask( vmask m ) { return _mm_movemask_ps( m.v ); }
+
+#else
+
+#include <math.h>
+#include <string.h>
+
+struct vfloat { float v[SIMD_WIDTH]; };
+struct vmask { bool v[SIMD_WIDTH]; };
+
+#define SIMD_LANES( expr ) for ( int l = 0; l < SIMD_WIDTH; l ++ ) { expr; }
+
+inline vfloat	vset1( float f ) { vfloat r; SIMD_LANES( r.v[l] = f ); return r; }
+inline vfloat	vramp( ) { vfloat r; SIMD_LANES( r.v[l] = ( float )l ); return r; }
+inline vfloat	vload( const float* p ) { vfloat r; SIMD_LANES( r.v[l] = p[l] ); return r; }
+inline vfloat	vconvert( const int* p ) { vfloat r; SIMD_LANES( r.v[l] = ( float )p[l] ); return r; }
+inline vfloat	vloadbits( const int* p ) { vfloat r; memcpy( r.v, p, sizeof( r.v ) ); return r; }
+inline void		vstore( float* p, vfloat a ) { SIMD_LANES( p[l] = a.v[l] ); }
+inline vfloat	operator + ( vfloat a, vfloat b ) { SIMD_LANES( a.v[l] += b.v[l] ); return a; }
+inline vfloat	operator - ( vfloat a, vfloat b ) { SIMD_LANES( a.v[l] -= b.v[l] ); return a; }
+inline vfloat	operator * ( vfloat a, vfloat b ) { SIMD_LANES( a.v[l] *= b.v[l] ); return a; }
+inline vfloat	operator / ( vfloat a, vfloat b ) { SIMD_LANES( a.v[l] /= b.v[l] ); return a; }
+inline vfloat	vmin( vfloat a, vfloat b ) { SIMD_LANES( a.v[l] = b.v[l] < a.v[l] ? b.v[l] : a.v[l] ); return a; }
+inline vfloat	vmax( vfloat a, vfloat b ) { SIMD_LANES( a.v[l] = b.v[l] > a.v[l] ? b.v[l] : a.v[l] ); return a; }
+inline vfloat	vrsqrt_approx( vfloat a ) { SIMD_LANES( a.v[l] = 1.f / sqrtf( a.v[l] ) ); return a; }
+inline vfloat	vround( vfloat a ) { SIMD_LANES( a.v[l] = nearbyintf( a.v[l] ) ); return a; }
+inline vmask	operator >= ( vfloat a, vfloat b ) { vmask r; SIMD_LANES( r.v[l] = a.v[l] >= b.v[l] ); return r; }
+inline vmask	operator <= ( vfloat a, vfloat b ) { vmask r; SIMD_LANES( r.v[l] = a.v[l] <= b.v[l] ); return r; }
+inline vmask	operator & ( vmask a, vmask b ) { SIMD_LANES( a.v[l] = a.v[l] && b.v[l] ); return a; }
+inline vfloat	vselect( vmask m, vfloat a, vfloat b ) { SIMD_LANES( a.v[l] = m.v[l] ? a.v[l] : b.v[l] ); return a; }
+inline int		vmovemask( vmask m ) { int r = 0; SIMD_LANES( r |= m.v[l] ? 1 << l : 0 ); return r; }
+
+#undef SIMD_LANES
+
+#endif
+
+// 1 / sqrt( a ) refined by one newton-raphson step, relative error below 5e-7 for a > 0
+inline vfloat vrsqrt( vfloat a )
+{
+	vfloat r = vrsqrt_approx( a );
+	return r * ( vset1( 1.5f ) - vset1( 0.5f ) * a * r * r );
+}
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "Texture.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static inline bool IsPowerOfTwo( int n )
+{
+	return n > 0 && ( n & ( n - 1 ) ) == 0;
+}
+
+static inline int Log2( int n )
+{
+	int l = 0;
+	while ( ( 1 << l ) < n ) l ++;
+	return l;
+}
+
+// bit i of v goes to bit 2 * i + offset while both axes still have bits, the remaining high bits of the
+// longer axis are packed above the interleaved ones
+static uint32 MortonSpread( uint32 v, int bits, int shared, int offset )
+{
+	uint32 r = 0;
+	for ( int i = 0; i < bits; i ++ )
+	{
+		if ( ( v >> i ) & 1 ) r |= 1u << ( i < shared ? 2 * i + offset : shared + i );
+	}
+	return r;
+}
+
+static inline Color UnpackColor( uint32 c )
+{
+	const float inv = 1.f / 255.f;
+	return { ( ( c >> 16 ) & 0xff ) * inv, ( ( c >> 8 ) & 0xff ) * inv, ( c & 0xff ) * inv };
+}
+
+int Texture::init( const uint32* pixels, int width, int height )
+{
+	close( );
+
+	if ( !IsPowerOfTwo( width ) || !IsPowerOfTwo( height ) ) return -1;
+	if ( Log2( std::max( width, height ) ) >= MAX_LEVELS ) return -1;
+
+	levelCount = Log2( std::max( width, height ) ) + 1;
+
+	size_t texelCount = 0, swizzleCount = 0;
+	for ( int l = 0; l < levelCount; l ++ )
+	{
+		int w = std::max( width >> l, 1 ), h = std::max( height >> l, 1 );
+		texelCount += w * h;
+		swizzleCount += w + h;
+	}
+
+	texels = ( uint32* )malloc( texelCount * sizeof( uint32 ) );
+	swizzle = ( uint32* )malloc( swizzleCount * sizeof( uint32 ) );
+	if ( texels == NULL || swizzle == NULL )
+	{
+		close( );
+		return -2;
+	}
+
+	uint32* t = texels;
+	uint32* s = swizzle;
+	for ( int l = 0; l < levelCount; l ++ )
+	{
+		Level& level = levels[l];
+		level.width = std::max( width >> l, 1 );
+		level.height = std::max( height >> l, 1 );
+		level.texels = t;
+		t += level.width * level.height;
+
+		int bitsX = Log2( level.width ), bitsY = Log2( level.height ), shared = std::min( bitsX, bitsY );
+		for ( int x = 0; x < level.width; x ++ ) s[x] = MortonSpread( x, bitsX, shared, 0 );
+		level.mortonX = s;
+		s += level.width;
+		for ( int y = 0; y < level.height; y ++ ) s[y] = MortonSpread( y, bitsY, shared, 1 );
+		level.mortonY = s;
+		s += level.height;
+	}
+
+	Level& base = levels[0];
+	for ( int y = 0; y < height; y ++ )
+	{
+		for ( int x = 0; x < width; x ++ )
+		{
+			base.texels[base.mortonX[x] | base.mortonY[y]] = pixels[y * width + x] & 0xffffff;
+		}
+	}
+
+	// box filter every level from the one above, a side that is already 1 texel wide is not halved
+	for ( int l = 1; l < levelCount; l ++ )
+	{
+		const Level& src = levels[l - 1];
+		Level& dst = levels[l];
+		int sx = src.width > 1 ? 2 : 1, sy = src.height > 1 ? 2 : 1;
+		for ( int y = 0; y < dst.height; y ++ )
+		{
+			for ( int x = 0; x < dst.width; x ++ )
+			{
+				uint32 c00 = fetch( src, x * sx, y * sy ), c10 = fetch( src, x * sx + sx - 1, y * sy );
+				uint32 c01 = fetch( src, x * sx, y * sy + sy - 1 ), c11 = fetch( src, x * sx + sx - 1, y * sy + sy - 1 );
+				uint32 r = ( ( ( c00 >> 16 ) & 0xff ) + ( ( c10 >> 16 ) & 0xff ) + ( ( c01 >> 16 ) & 0xff ) + ( ( c11 >> 16 ) & 0xff ) + 2 ) >> 2;
+				uint32 g = ( ( ( c00 >> 8 ) & 0xff ) + ( ( c10 >> 8 ) & 0xff ) + ( ( c01 >> 8 ) & 0xff ) + ( ( c11 >> 8 ) & 0xff ) + 2 ) >> 2;
+				uint32 b = ( ( c00 & 0xff ) + ( c10 & 0xff ) + ( c01 & 0xff ) + ( c11 & 0xff ) + 2 ) >> 2;
+				dst.texels[dst.mortonX[x] | dst.mortonY[y]] = ( r << 16 ) | ( g << 8 ) | b;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void Texture::close( )
+{
+	if ( texels != NULL )
+	{
+		free( texels );
+		texels = NULL;
+	}
+	if ( swizzle != NULL )
+	{
+		free( swizzle );
+		swizzle = NULL;
+	}
+	levelCount = 0;
+}
+
+float Texture::computeLod( float dudx, float dvdx, float dudy, float dvdy ) const
+{
+	if ( levelCount == 0 ) return 0.f;
+
+	// footprint of one pixel in base level texels along the longer screen axis
+	float w = ( float )levels[0].width, h = ( float )levels[0].height;
+	float lx = ( dudx * w ) * ( dudx * w ) + ( dvdx * h ) * ( dvdx * h );
+	float ly = ( dudy * w ) * ( dudy * w ) + ( dvdy * h ) * ( dvdy * h );
+	float rho2 = std::max( lx, ly );
+	if ( !( rho2 > 1.f ) ) return 0.f;
+
+	return 0.5f * log2f( rho2 );
+}
+
+Color Texture::sampleNearest( const Level& level, float u, float v ) const
+{
+	int x = ( int )floor( u * level.width );
+	int y = ( int )floor( v * level.height );
+	return UnpackColor( fetch( level, x, y ) );
+}
+
+Color Texture::sampleBilinear( const Level& level, float u, float v ) const
+{
+	float fx = u * level.width - 0.5f, fy = v * level.height - 0.5f;
+	float x0f = ( float )floor( fx ), y0f = ( float )floor( fy );
+	float tx = fx - x0f, ty = fy - y0f;
+	int x0 = ( int )x0f, y0 = ( int )y0f;
+
+	Color c00 = UnpackColor( fetch( level, x0, y0 ) );
+	Color c10 = UnpackColor( fetch( level, x0 + 1, y0 ) );
+	Color c01 = UnpackColor( fetch( level, x0, y0 + 1 ) );
+	Color c11 = UnpackColor( fetch( level, x0 + 1, y0 + 1 ) );
+
+	Color top = c00 * ( 1.f - tx ) + c10 * tx;
+	Color bottom = c01 * ( 1.f - tx ) + c11 * tx;
+	return top * ( 1.f - ty ) + bottom * ty;
+}
+
+Color Texture::sample( float u, float v, float lod, TextureFilter filter ) const
+{
+	if ( levelCount == 0 ) return { 1.f, 1.f, 1.f };
+
+	// keep the coordinates small so the float to int conversion stays exact, addressing wraps anyway
+	u -= ( float )floor( u );
+	v -= ( float )floor( v );
+
+	float maxLod = ( float )( levelCount - 1 );
+	lod = std::min( std::max( lod, 0.f ), maxLod );
+
+	switch ( filter )
+	{
+		case TextureFilter::NEAREST:
+			return sampleNearest( levels[( int )( lod + 0.5f )], u, v );
+		case TextureFilter::BILINEAR:
+			return sampleBilinear( levels[( int )( lod + 0.5f )], u, v );
+		default:
+		{
+			int l0 = ( int )lod;
+			float t = lod - l0;
+			Color c0 = sampleBilinear( levels[l0], u, v );
+			if ( t == 0.f ) return c0;
+			Color c1 = sampleBilinear( levels[l0 + 1], u, v );
+			return c0 * ( 1.f - t ) + c1 * t;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Config.h"
+#include "math.h"
+#include "Vertex.h"
+#include <stddef.h>
+
+enum class TextureFilter { NEAREST, BILINEAR, TRILINEAR };
+
+// mip mapped 0xRRGGBB texture with power of two sizes and repeat addressing; every level is stored in
+// morton ( z-order ) texel order, so the 2x2 footprint of a bilinear fetch and the texels read by
+// neighbouring pixels share cache lines in both directions
+class Texture
+{
+public:
+	inline Texture( ) : texels( NULL ), swizzle( NULL ), levelCount( 0 ) { }
+	inline ~Texture( ) { close( ); }
+
+	int		init( const uint32* pixels, int width, int height );
+	void	close( );
+
+	// mip level from the screen space derivatives of the normalized texture coordinates
+	float	computeLod( float dudx, float dvdx, float dudy, float dvdy ) const;
+	Color	sample( float u, float v, float lod, TextureFilter filter ) const;
+
+	inline int	getWidth( ) const { return levelCount > 0 ? levels[0].width : 0; }
+	inline int	getHeight( ) const { return levelCount > 0 ? levels[0].height : 0; }
+	inline int	getLevelCount( ) const { return levelCount; }
+
+private:
+	Texture( const Texture& );
+	Texture& operator = ( const Texture& );
+
+	struct Level
+	{
+		int				width;
+		int				height;
+		uint32*			texels;
+		const uint32*	mortonX;	// texel ( x, y ) lives at texels[mortonX[x] | mortonY[y]]
+		const uint32*	mortonY;
+	};
+
+	inline uint32	fetch( const Level& level, int x, int y ) const
+	{
+		return level.texels[level.mortonX[x & ( level.width - 1 )] | level.mortonY[y & ( level.height - 1 )]];
+	}
+	Color	sampleNearest( const Level& level, float u, float v ) const;
+	Color	sampleBilinear( const Level& level, float u, float v ) const;
+
+	static const int MAX_LEVELS = 16;
+
+	uint32*	texels;		// all levels back to back
+	uint32*	swizzle;	// morton tables of all levels
+	Level	levels[MAX_LEVELS];
+	int		levelCount;
+};
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "ThreadPool.h"
+
+void ThreadPool::init( int threadCount )
+{
+	close( );
+
+	stopping = false;
+	for ( int i = 1; i < threadCount; i ++ )
+	{
+		threads.push_back( std::thread( &ThreadPool::workerLoop, this ) );
+	}
+}
+
+void ThreadPool::close( )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stopping = true;
+	}
+	wake.notify_all( );
+
+	for ( size_t i = 0; i < threads.size( ); i ++ )
+	{
+		threads[i].join( );
+	}
+	threads.clear( );
+}
+
+void ThreadPool::run( int count, const std::function<void( int )>& fn )
+{
+	if ( count <= 0 ) return;
+
+	if ( threads.empty( ) || count == 1 )
+	{
+		for ( int i = 0; i < count; i ++ ) fn( i );
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		task = &fn;
+		taskCount = count;
+		next = 0;
+		busy = ( int )threads.size( );
+		generation ++;
+	}
+	wake.notify_all( );
+
+	drain( );
+
+	std::unique_lock<std::mutex> lock( mutex );
+	done.wait( lock, [this] { return busy == 0; } );
+	task = NULL;
+}
+
+void ThreadPool::drain( )
+{
+	for ( int i = next ++; i < taskCount; i = next ++ )
+	{
+		( *task )( i );
+	}
+}
+
+void ThreadPool::workerLoop( )
+{
+	unsigned seen = 0;
+	while ( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			wake.wait( lock, [this, seen] { return stopping || generation != seen; } );
+			if ( stopping ) return;
+			seen = generation;
+		}
+
+		drain( );
+
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			busy --;
+		}
+		done.notify_one( );
+	}
+}
+
+void JobQueue::init( )
+{
+	close( );
+
+	stopping = false;
+	thread = std::thread( &JobQueue::workerLoop, this );
+}
+
+void JobQueue::close( )
+{
+	if ( !thread.joinable( ) ) return;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stopping = true;
+	}
+	wake.notify_one( );
+	thread.join( );
+}
+
+unsigned long long JobQueue::push( const std::function<void( )>& job )
+{
+	unsigned long long ticket;
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		jobs.push_back( job );
+		ticket = ++ submitted;
+	}
+	wake.notify_one( );
+	return ticket;
+}
+
+void JobQueue::wait( unsigned long long ticket )
+{
+	std::unique_lock<std::mutex> lock( mutex );
+	done.wait( lock, [this, ticket] { return completed >= ticket; } );
+}
+
+void JobQueue::wait( )
+{
+	std::unique_lock<std::mutex> lock( mutex );
+	done.wait( lock, [this] { return completed >= submitted; } );
+}
+
+bool JobQueue::isDone( unsigned long long ticket )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	return completed >= ticket;
+}
+
+void JobQueue::workerLoop( )
+{
+	while ( true )
+	{
+		std::function<void( )> job;
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			wake.wait( lock, [this] { return stopping || !jobs.empty( ); } );
+			if ( jobs.empty( ) ) return;
+			job = std::move( jobs.front( ) );
+			jobs.pop_front( );
+		}
+
+		job( );
+
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			completed ++;
+		}
+		done.notify_all( );
+	}
+}
\ No newline at end of file
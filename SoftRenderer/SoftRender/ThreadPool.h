@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads running indexed tasks; the calling thread takes part in every run
+class ThreadPool
+{
+public:
+	inline ThreadPool( ) : task( NULL ), taskCount( 0 ), busy( 0 ), generation( 0 ), stopping( false ) { next = 0; }
+	inline ~ThreadPool( ) { close( ); }
+
+	void	init( int threadCount );
+	void	close( );
+	void	run( int count, const std::function<void( int )>& fn );
+
+	inline int	getThreadCount( ) const { return ( int )threads.size( ) + 1; }
+
+private:
+	ThreadPool( const ThreadPool& );
+	ThreadPool& operator = ( const ThreadPool& );
+
+	void	workerLoop( );
+	void	drain( );
+
+	std::vector<std::thread>			threads;
+	std::mutex							mutex;
+	std::condition_variable				wake;
+	std::condition_variable				done;
+	const std::function<void( int )>*	task;
+	int									taskCount;
+	std::atomic<int>					next;
+	int									busy;
+	unsigned							generation;
+	bool								stopping;
+};
+
+// one background thread running jobs in the order they were pushed; Device records the next frame on the
+// calling thread while this rasterizes the previous one
+class JobQueue
+{
+public:
+	inline JobQueue( ) : submitted( 0 ), completed( 0 ), stopping( false ) { }
+	inline ~JobQueue( ) { close( ); }
+
+	void	init( );
+	// runs every job still queued, then joins the thread
+	void	close( );
+	// returns the ticket of the job for wait( ) and isDone( )
+	unsigned long long	push( const std::function<void( )>& job );
+	// blocks until the job with that ticket and all before it have run
+	void	wait( unsigned long long ticket );
+	void	wait( );
+	bool	isDone( unsigned long long ticket );
+
+private:
+	JobQueue( const JobQueue& );
+	JobQueue& operator = ( const JobQueue& );
+
+	void	workerLoop( );
+
+	std::thread							thread;
+	std::mutex							mutex;
+	std::condition_variable				wake;
+	std::condition_variable				done;
+	std::deque<std::function<void( )>>	jobs;
+	unsigned long long					submitted;
+	unsigned long long					completed;
+	bool								stopping;
+};
\ No newline at end of file
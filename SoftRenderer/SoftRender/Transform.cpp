@@ -1,4 +1,5 @@
 #include "Transform.h"
+#include "SimdFloat.h"
 
 #define PI 3.1415926f
 
@@ -8,16 +9,29 @@ void Transform::init( const int& w, const int& h )
 	height = h;
 	MatrixSetIdentity( world );
 	MatrixSetIdentity( view );
+	setDepthRange( 1.f, 500.f, false );
+}
+
+void Transform::setDepthRange( float zn, float zf, bool reversed )
+{
 	float aspect = ( float )width / height;
-	MatrixSetPerspective( projection, PI * 0.5f, aspect, 1.f, 500.f );
+	MatrixSetPerspective( projection, PI * 0.5f, aspect, reversed ? zf : zn, reversed ? zn : zf );
 	update( );
 }
 
 void Transform::update( )
 {
-	Matrix m;
-	MatrixMul( m, world, view );
-	MatrixMul( transform, m, projection );
+	MatrixMul( worldView, world, view );
+	MatrixMul( transform, worldView, projection );
+}
+
+float Transform::projectedRadius( const Vector& center, float radius ) const
+{
+	// clip w is the view space depth, and the projection scales y by m[1][1] before the divide by it
+	Vector v;
+	MatrixApply( v, center, view );
+	if ( v.z <= radius ) return 1e30f;
+	return radius * projection.m[1][1] / v.z * height * 0.5f;
 }
 
 void Transform::homogenizeVert( Vector& sv, const Vector& pv )
@@ -28,4 +42,28 @@ void Transform::homogenizeVert( Vector& sv, const Vector& pv )
 	sv.y = ( - pv.y / rhw + 1.f ) * height * 0.5f;
 	sv.z = pv.z / rhw;
 	sv.w = 1.f;
+}
+
+void Transform::homogenizeBatch( VectorSoA& sv, const VectorSoA& pv, int count )
+{
+	// w == 0 lanes come out as inf / nan instead of being skipped, they lie behind the near plane anyway
+	vfloat one = vset1( 1.f ), hw = vset1( width * 0.5f ), hh = vset1( height * 0.5f );
+	int i = 0;
+	for ( ; i + SIMD_WIDTH <= count; i += SIMD_WIDTH )
+	{
+		vfloat rhw = vload( pv.w + i );
+		vstore( sv.x + i, ( vload( pv.x + i ) / rhw + one ) * hw );
+		vstore( sv.y + i, ( vset1( 0.f ) - vload( pv.y + i ) / rhw + one ) * hh );
+		vstore( sv.z + i, vload( pv.z + i ) / rhw );
+		vstore( sv.w + i, one );
+	}
+	for ( ; i < count; i ++ )
+	{
+		Vector s = { 0.f, 0.f, 0.f, 1.f };
+		homogenizeVert( s, { pv.x[i], pv.y[i], pv.z[i], pv.w[i] } );
+		sv.x[i] = s.x;
+		sv.y[i] = s.y;
+		sv.z[i] = s.z;
+		sv.w[i] = s.w;
+	}
 }
\ No newline at end of file
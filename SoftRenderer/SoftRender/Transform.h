@@ -5,18 +5,36 @@ class Transform
 {
 public:
 	void init( const int& width, const int& height );
+	// perspective of init( ) over view depths zn to zf, mapped to depth 1 to 0 instead of 0 to 1 when reversed,
+	// as DepthFormat::FLOAT32_REVERSED expects; init( ) uses 1 to 500 not reversed
+	void setDepthRange( float zn, float zf, bool reversed );
 	void update( );
 	void homogenizeVert( Vector& sv, const Vector& pv );
 
 	inline void applyWVP( Vector& b, const Vector& a ) { MatrixApply( b, a, transform ); }
-	inline void applyWV( Vector& b, const Vector& a ) { MatrixApply( b, a, transform ); }
+	// world and view only, so a direction brought into view space does not depend on the projection
+	inline void applyWV( Vector& b, const Vector& a ) { MatrixApply( b, a, worldView ); }
+
+	// whole vertex buffers in SoA form: points to clip space, normals by the world matrix ( which must not
+	// scale non-uniformly ), and clip space to screen space like homogenizeVert
+	inline void applyWVPBatch( VectorSoA& b, const VectorSoA& a, int count ) { MatrixApplySoA( b, a, count, transform ); }
+	inline void applyWorldNormalBatch( VectorSoA& b, const VectorSoA& a, int count ) { MatrixApplyNormalSoA( b, a, count, world ); }
+	inline void applyWorldNormal( Vector& b, const Vector& a ) const { MatrixApply( b, { a.x, a.y, a.z, 0.f }, world ); }
+	inline void applyWorld( Vector& b, const Vector& a ) const { MatrixApply( b, a, world ); }
+	void homogenizeBatch( VectorSoA& sv, const VectorSoA& pv, int count );
 	inline void setWorld( const Matrix& m ) { world = m; }
 	inline void setView( const Matrix& m ) { view = m; }
+	// replaces the perspective projection of init( ), e.g. with an orthographic one for a directional light
+	inline void setProjection( const Matrix& m ) { projection = m; }
+	inline void getViewProjection( Matrix& m ) const { MatrixMul( m, view, projection ); }
+	// radius in pixels of a world space sphere as seen on screen, huge once the camera is inside it
+	float projectedRadius( const Vector& center, float radius ) const;
 
 private:
 	Matrix	world;
 	Matrix	view;
 	Matrix	projection;
+	Matrix	worldView;
 	Matrix	transform;
 	int		width;
 	int		height;
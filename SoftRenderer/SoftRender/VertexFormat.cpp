@@ -0,0 +1,306 @@
+#include "VertexFormat.h"
+#include "SimdFloat.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// a half whose bits sit where a float keeps its top exponent and mantissa bits is the value * 2 ^ -112,
+// denormals included
+static const float HALF_BIAS = 5.192297e+33f;	// 2 ^ 112
+
+static uint16 FloatToHalf( float f )
+{
+	uint32 bits;
+	memcpy( &bits, &f, sizeof( bits ) );
+	uint32 sign = ( bits >> 16 ) & 0x8000;
+
+	float a = fabsf( f );
+	if ( !( a < 65504.f ) ) return ( uint16 )( sign | 0x7bff );
+	if ( a < 6.1035156e-05f ) return ( uint16 )( sign | ( uint32 )lrintf( a * 16777216.f ) );
+
+	// round to nearest even on the 13 dropped mantissa bits, a carry correctly bumps the exponent
+	memcpy( &bits, &a, sizeof( bits ) );
+	uint32 h = ( ( ( bits >> 23 ) - 112 ) << 10 ) | ( ( bits & 0x7fffff ) >> 13 );
+	uint32 rest = bits & 0x1fff;
+	if ( rest > 0x1000 || ( rest == 0x1000 && ( h & 1 ) ) ) h ++;
+	return ( uint16 )( sign | std::min( h, 0x7bffu ) );
+}
+
+static inline int HalfBits( uint16 h )
+{
+	return ( int )( ( ( h & 0x7fffu ) << 13 ) | ( ( h & 0x8000u ) << 16 ) );
+}
+
+static inline short Snorm16( float f )
+{
+	return ( short )lrintf( std::min( std::max( f, -1.f ), 1.f ) * 32767.f );
+}
+
+static inline uint32 Unorm8( float f )
+{
+	return ( uint32 )lrintf( std::min( std::max( f, 0.f ), 1.f ) * 255.f );
+}
+
+// the normal scaled onto the octahedron |x| + |y| + |z| = 1, whose lower half is folded over the diagonals
+static void EncodeOctahedral( const Vector& n, short* out )
+{
+	float l = fabsf( n.x ) + fabsf( n.y ) + fabsf( n.z );
+	float x = l > 0.f ? n.x / l : 0.f, y = l > 0.f ? n.y / l : 0.f;
+	if ( n.z < 0.f )
+	{
+		float fx = ( 1.f - fabsf( y ) ) * ( x >= 0.f ? 1.f : -1.f );
+		float fy = ( 1.f - fabsf( x ) ) * ( y >= 0.f ? 1.f : -1.f );
+		x = fx;
+		y = fy;
+	}
+	out[0] = Snorm16( x );
+	out[1] = Snorm16( y );
+}
+
+void GetVertexLayout( VertexLayout& layout, const VertexFormat& format )
+{
+	static const int NORMAL_SIZE[] = { 0, 12, 4 };
+	static const int COLOR_SIZE[] = { 0, 12, 8, 4 };	// three halves are padded to 8 bytes
+	static const int TEXCOORD_SIZE[] = { 0, 8, 4 };
+
+	layout.normal = 12;
+	layout.color = layout.normal + NORMAL_SIZE[( int )format.normal];
+	layout.texcoord = layout.color + COLOR_SIZE[( int )format.color];
+	layout.stride = layout.texcoord + TEXCOORD_SIZE[( int )format.texcoord];
+}
+
+int PackMesh( PackedMesh& out, const VertexFormat& format, const Vertex* vertices, int vertexCount,
+	const uint32* indices, int indexCount )
+{
+	for ( int i = 0; i < indexCount; i ++ )
+	{
+		if ( indices[i] >= ( uint32 )vertexCount ) return -1;
+	}
+
+	out.format = format;
+	GetVertexLayout( out.layout, format );
+	out.vertexCount = vertexCount;
+	out.indexCount = indexCount;
+	out.indexSize = vertexCount <= 65536 ? 2 : 4;
+	out.vertexData.assign( ( size_t )vertexCount * out.layout.stride, 0 );
+	out.indexData.resize( ( size_t )indexCount * out.indexSize );
+
+	for ( int i = 0; i < vertexCount; i ++ )
+	{
+		const Vertex& v = vertices[i];
+		unsigned char* dst = out.vertexData.data( ) + ( size_t )i * out.layout.stride;
+
+		float pos[3] = { v.pos.x, v.pos.y, v.pos.z };
+		memcpy( dst, pos, sizeof( pos ) );
+
+		unsigned char* normal = dst + out.layout.normal;
+		if ( format.normal == NormalFormat::FLOAT3 )
+		{
+			float n[3] = { v.normal.x, v.normal.y, v.normal.z };
+			memcpy( normal, n, sizeof( n ) );
+		}
+		else if ( format.normal == NormalFormat::OCT16 )
+		{
+			short n[2];
+			EncodeOctahedral( v.normal, n );
+			memcpy( normal, n, sizeof( n ) );
+		}
+
+		unsigned char* color = dst + out.layout.color;
+		if ( format.color == ColorFormat::FLOAT3 )
+		{
+			float c[3] = { v.color.r, v.color.g, v.color.b };
+			memcpy( color, c, sizeof( c ) );
+		}
+		else if ( format.color == ColorFormat::HALF3 )
+		{
+			uint16 c[3] = { FloatToHalf( v.color.r ), FloatToHalf( v.color.g ), FloatToHalf( v.color.b ) };
+			memcpy( color, c, sizeof( c ) );
+		}
+		else if ( format.color == ColorFormat::UNORM8 )
+		{
+			uint32 c = ( Unorm8( v.color.r ) << 16 ) | ( Unorm8( v.color.g ) << 8 ) | Unorm8( v.color.b );
+			memcpy( color, &c, sizeof( c ) );
+		}
+
+		unsigned char* tex = dst + out.layout.texcoord;
+		if ( format.texcoord == TexcoordFormat::FLOAT2 )
+		{
+			float t[2] = { v.tex.u, v.tex.v };
+			memcpy( tex, t, sizeof( t ) );
+		}
+		else if ( format.texcoord == TexcoordFormat::HALF2 )
+		{
+			uint16 t[2] = { FloatToHalf( v.tex.u ), FloatToHalf( v.tex.v ) };
+			memcpy( tex, t, sizeof( t ) );
+		}
+	}
+
+	for ( int i = 0; i < indexCount; i ++ )
+	{
+		if ( out.indexSize == 2 )
+			( ( uint16* )out.indexData.data( ) )[i] = ( uint16 )indices[i];
+		else
+			( ( uint32* )out.indexData.data( ) )[i] = indices[i];
+	}
+	return 0;
+}
+
+// every decoder below turns up to SIMD_WIDTH vertices at src into their attribute in dst: the packed fields are
+// gathered into lanes and everything after that is done on whole registers
+static void UnpackNormals( Vertex* dst, const unsigned char* src, int stride, int n, NormalFormat format )
+{
+	if ( format != NormalFormat::OCT16 )
+	{
+		for ( int l = 0; l < n; l ++ )
+		{
+			const float* p = ( const float* )( src + l * stride );
+			dst[l].normal = format == NormalFormat::FLOAT3 ? Vector { p[0], p[1], p[2], 0.f } : Vector { 0.f, 0.f, 0.f, 0.f };
+		}
+		return;
+	}
+
+	int u[SIMD_WIDTH] = { 0 }, v[SIMD_WIDTH] = { 0 };
+	for ( int l = 0; l < n; l ++ )
+	{
+		const short* p = ( const short* )( src + l * stride );
+		u[l] = p[0];
+		v[l] = p[1];
+	}
+
+	// unfold the lower half of the octahedron: points past the diagonals move back by how far z went below 0
+	vfloat zero = vset1( 0.f ), scale = vset1( 1.f / 32767.f );
+	vfloat x = vconvert( u ) * scale, y = vconvert( v ) * scale;
+	vfloat z = vset1( 1.f ) - vmax( x, zero - x ) - vmax( y, zero - y );
+	vfloat t = vmax( zero - z, zero );
+	x = x + vselect( x >= zero, zero - t, t );
+	y = y + vselect( y >= zero, zero - t, t );
+	vfloat inv = vrsqrt( x * x + y * y + z * z );
+
+	float nx[SIMD_WIDTH], ny[SIMD_WIDTH], nz[SIMD_WIDTH];
+	vstore( nx, x * inv );
+	vstore( ny, y * inv );
+	vstore( nz, z * inv );
+	for ( int l = 0; l < n; l ++ )
+	{
+		dst[l].normal = { nx[l], ny[l], nz[l], 0.f };
+	}
+}
+
+static void UnpackColors( Vertex* dst, const unsigned char* src, int stride, int n, ColorFormat format )
+{
+	if ( format == ColorFormat::NONE || format == ColorFormat::FLOAT3 )
+	{
+		for ( int l = 0; l < n; l ++ )
+		{
+			const float* p = ( const float* )( src + l * stride );
+			dst[l].color = format == ColorFormat::FLOAT3 ? Color { p[0], p[1], p[2] } : Color { 1.f, 1.f, 1.f };
+		}
+		return;
+	}
+
+	int r[SIMD_WIDTH] = { 0 }, g[SIMD_WIDTH] = { 0 }, b[SIMD_WIDTH] = { 0 };
+	vfloat scale;
+	if ( format == ColorFormat::HALF3 )
+	{
+		for ( int l = 0; l < n; l ++ )
+		{
+			const uint16* p = ( const uint16* )( src + l * stride );
+			r[l] = HalfBits( p[0] );
+			g[l] = HalfBits( p[1] );
+			b[l] = HalfBits( p[2] );
+		}
+		scale = vset1( HALF_BIAS );
+	}
+	else
+	{
+		for ( int l = 0; l < n; l ++ )
+		{
+			uint32 c = *( const uint32* )( src + l * stride );
+			r[l] = ( c >> 16 ) & 0xff;
+			g[l] = ( c >> 8 ) & 0xff;
+			b[l] = c & 0xff;
+		}
+		scale = vset1( 1.f / 255.f );
+	}
+
+	float cr[SIMD_WIDTH], cg[SIMD_WIDTH], cb[SIMD_WIDTH];
+	bool half = format == ColorFormat::HALF3;
+	vstore( cr, ( half ? vloadbits( r ) : vconvert( r ) ) * scale );
+	vstore( cg, ( half ? vloadbits( g ) : vconvert( g ) ) * scale );
+	vstore( cb, ( half ? vloadbits( b ) : vconvert( b ) ) * scale );
+	for ( int l = 0; l < n; l ++ )
+	{
+		dst[l].color = { cr[l], cg[l], cb[l] };
+	}
+}
+
+static void UnpackTexcoords( Vertex* dst, const unsigned char* src, int stride, int n, TexcoordFormat format )
+{
+	if ( format != TexcoordFormat::HALF2 )
+	{
+		for ( int l = 0; l < n; l ++ )
+		{
+			const float* p = ( const float* )( src + l * stride );
+			dst[l].tex = format == TexcoordFormat::FLOAT2 ? Texcoord { p[0], p[1] } : Texcoord { 0.f, 0.f };
+		}
+		return;
+	}
+
+	int u[SIMD_WIDTH] = { 0 }, v[SIMD_WIDTH] = { 0 };
+	for ( int l = 0; l < n; l ++ )
+	{
+		const uint16* p = ( const uint16* )( src + l * stride );
+		u[l] = HalfBits( p[0] );
+		v[l] = HalfBits( p[1] );
+	}
+
+	float tu[SIMD_WIDTH], tv[SIMD_WIDTH];
+	vstore( tu, vloadbits( u ) * vset1( HALF_BIAS ) );
+	vstore( tv, vloadbits( v ) * vset1( HALF_BIAS ) );
+	for ( int l = 0; l < n; l ++ )
+	{
+		dst[l].tex = { tu[l], tv[l] };
+	}
+}
+
+void UnpackVertices( Vertex* out, const PackedMesh& mesh, int first, int count )
+{
+	const VertexLayout& layout = mesh.layout;
+	for ( int i = 0; i < count; i += SIMD_WIDTH )
+	{
+		int n = std::min( SIMD_WIDTH, count - i );
+		const unsigned char* src = mesh.vertexData.data( ) + ( size_t )( first + i ) * layout.stride;
+		Vertex* dst = out + i;
+
+		for ( int l = 0; l < n; l ++ )
+		{
+			const float* p = ( const float* )( src + l * layout.stride );
+			dst[l].pos = { p[0], p[1], p[2], 1.f };
+		}
+		UnpackNormals( dst, src + layout.normal, layout.stride, n, mesh.format.normal );
+		UnpackColors( dst, src + layout.color, layout.stride, n, mesh.format.color );
+		UnpackTexcoords( dst, src + layout.texcoord, layout.stride, n, mesh.format.texcoord );
+	}
+}
+
+void ComputeMeshBounds( Vector& min, Vector& max, const PackedMesh& mesh )
+{
+	min = { 0.f, 0.f, 0.f, 1.f };
+	max = { 0.f, 0.f, 0.f, 1.f };
+	if ( mesh.vertexCount <= 0 ) return;
+
+	const float* p = ( const float* )mesh.vertexData.data( );
+	min = { p[0], p[1], p[2], 1.f };
+	max = min;
+	for ( int i = 1; i < mesh.vertexCount; i ++ )
+	{
+		p = ( const float* )( mesh.vertexData.data( ) + ( size_t )i * mesh.layout.stride );
+		min.x = std::min( min.x, p[0] );
+		min.y = std::min( min.y, p[1] );
+		min.z = std::min( min.z, p[2] );
+		max.x = std::max( max.x, p[0] );
+		max.y = std::max( max.y, p[1] );
+		max.z = std::max( max.z, p[2] );
+	}
+}
\ No newline at end of file
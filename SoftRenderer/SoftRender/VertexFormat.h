@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Config.h"
+#include "math.h"
+#include "Vertex.h"
+#include <vector>
+
+// encodings of the attributes of a packed vertex. OCT16 maps the unit normal onto the octahedron and stores it
+// as two snorm16 values, HALF* are IEEE half floats ( no infinities or nans ), UNORM8 is 0xRRGGBB in [0, 1]
+enum class NormalFormat { NONE, FLOAT3, OCT16 };
+enum class ColorFormat { NONE, FLOAT3, HALF3, UNORM8 };
+enum class TexcoordFormat { NONE, FLOAT2, HALF2 };
+
+// a position of three floats followed by the attributes present; missing ones unpack to a zero normal, white
+// and ( 0, 0 ), and pos.w is always 1
+struct VertexFormat
+{
+	NormalFormat	normal;
+	ColorFormat		color;
+	TexcoordFormat	texcoord;
+};
+
+// every attribute of Vertex at full precision, and 24 bytes with the least precision that still looks the same
+static const VertexFormat VERTEX_FORMAT_FLOAT = { NormalFormat::FLOAT3, ColorFormat::FLOAT3, TexcoordFormat::FLOAT2 };
+static const VertexFormat VERTEX_FORMAT_COMPACT = { NormalFormat::OCT16, ColorFormat::UNORM8, TexcoordFormat::HALF2 };
+
+// byte offsets of the attributes inside one vertex, every one 4 byte aligned
+struct VertexLayout
+{
+	int	normal;
+	int	color;
+	int	texcoord;
+	int	stride;
+};
+
+void	GetVertexLayout( VertexLayout& layout, const VertexFormat& format );
+
+// interleaved vertices in one format with a triangle list of 16 bit indices when every vertex can be reached
+// with them and 32 bit ones otherwise
+struct PackedMesh
+{
+	VertexFormat				format;
+	VertexLayout				layout;
+	int							vertexCount;
+	int							indexCount;
+	int							indexSize;
+	std::vector<unsigned char>	vertexData;
+	std::vector<unsigned char>	indexData;
+
+	inline const uint16*	getIndices16( ) const { return ( const uint16* )indexData.data( ); }
+	inline const uint32*	getIndices32( ) const { return ( const uint32* )indexData.data( ); }
+	inline size_t			getSize( ) const { return vertexData.size( ) + indexData.size( ); }
+};
+
+// returns -1 for an index past vertexCount
+int		PackMesh( PackedMesh& out, const VertexFormat& format, const Vertex* vertices, int vertexCount,
+	const uint32* indices, int indexCount );
+// decodes vertices [first, first + count) into out, SIMD_WIDTH at a time
+void	UnpackVertices( Vertex* out, const PackedMesh& mesh, int first, int count );
+void	ComputeMeshBounds( Vector& min, Vector& max, const PackedMesh& mesh );
\ No newline at end of file
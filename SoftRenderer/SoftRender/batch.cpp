@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "OffscreenScreen.h"
+#include "Device.h"
+#include "Transform.h"
+#include "Config.h"
+#include "Vertex.h"
+#include "Light.h"
+#include "DemoScene.h"
+#include "ObjLoader.h"
+#include "Texture.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "ShadowMap.h"
+#include "VertexFormat.h"
+
+// headless driver: renders the demo scene or an obj model as fast as possible and reports the frame rate
+// usage: SoftRenderingBatch [-n frames] [-w width] [-h height] [-m color|diffuse|phong|blinn|deferred] [-f model.obj] [-t threads] [-s 0|1]
+//                           [-x nearest|bilinear|trilinear] [-c 0|1] [-l 0|1] [-u 0|1] [-i instances] [-e lods]
+//                           [-q 1|2|3] [-g lights] [-y shadow map size] [-z 0|1|2] [-a 1|4|8] [-v float|compact]
+//                           [-d float|reversed|unorm24|unorm16] [-b far plane] [-p stats.json] [-r trace.json] [-o out.ppm]
+// -x adds a checker textured floor sampled with the given filter, -c 0 turns the per tile fast clear off,
+// -l 1 draws the model as a wireframe, -u 1 shades it with the toon material of DemoScene through drawShaded,
+// -i n places n copies of the model on a grid around the camera and draws them through a frustum culled Scene,
+// -e n gives those up to n simplified levels of detail picked by their size on screen,
+// -q 2 or 3 rasterizes each frame on a separate thread while the next one is transformed and binned,
+// -g n scatters n colored point lights around the model for -m deferred,
+// -y n casts the model's shadow from a light circling above it onto the floor through an n x n shadow map,
+// -z 1 draws the model depth only before shading it ( a z prepass ) and -z 2 draws nothing but that,
+// -a 4 or 8 antialiases the forward modes with that many coverage and depth samples per pixel,
+// -v packs the model ( and its instances and lods ) into VERTEX_FORMAT_FLOAT or VERTEX_FORMAT_COMPACT vertices
+// and draws it from there,
+// -d picks the depth buffer format of the frame and the shadow map, -b moves the far plane from 500 out ( or in ),
+// -p writes per frame stage times and counters and -r a chrome://tracing file ( both need a build with SOFTRENDER_PROFILE )
+
+static IlluminationMode ParseMode( const char* name )
+{
+	if ( strcmp( name, "color" ) == 0 ) return IlluminationMode::COLOR;
+	if ( strcmp( name, "diffuse" ) == 0 ) return IlluminationMode::DIFFUSE;
+	if ( strcmp( name, "phong" ) == 0 ) return IlluminationMode::PHONG;
+	if ( strcmp( name, "deferred" ) == 0 ) return IlluminationMode::DEFERRED;
+	return IlluminationMode::BLINN;
+}
+
+static TextureFilter ParseFilter( const char* name )
+{
+	if ( strcmp( name, "nearest" ) == 0 ) return TextureFilter::NEAREST;
+	if ( strcmp( name, "bilinear" ) == 0 ) return TextureFilter::BILINEAR;
+	return TextureFilter::TRILINEAR;
+}
+
+static DepthFormat ParseDepthFormat( const char* name )
+{
+	if ( strcmp( name, "reversed" ) == 0 ) return DepthFormat::FLOAT32_REVERSED;
+	if ( strcmp( name, "unorm24" ) == 0 ) return DepthFormat::UNORM24;
+	if ( strcmp( name, "unorm16" ) == 0 ) return DepthFormat::UNORM16;
+	return DepthFormat::FLOAT32;
+}
+
+// the loaded model, from its packed copy when -v made one
+static void DrawModel( Device* device, const MeshCache& mesh, const PackedMesh* packed )
+{
+	if ( packed != NULL )
+		device->drawMesh( *packed );
+	else
+		device->drawMesh( mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ) );
+}
+
+int main( int argc, char* argv[] )
+{
+	int frames = 1000;
+	int width = 800;
+	int height = 600;
+	IlluminationMode illuminationMode = IlluminationMode::BLINN;
+	const char* output = NULL;
+	const char* model = NULL;
+	int threads = 0;
+	int simd = 1;
+	const char* filter = NULL;
+	int fastClear = 1;
+	int wireframe = 0;
+	int toon = 0;
+	int instanceCount = 0;
+	int lodLevels = 0;
+	int pipelineDepth = 1;
+	int pointLightCount = 0;
+	int shadowSize = 0;
+	int depthPass = 0;
+	int samples = 1;
+	const char* vertexFormat = NULL;
+	DepthFormat depthFormat = DepthFormat::FLOAT32;
+	float farPlane = 500.f;
+	const char* stats = NULL;
+	const char* trace = NULL;
+
+	for ( int i = 1; i + 1 < argc; i += 2 )
+	{
+		if ( strcmp( argv[i], "-n" ) == 0 ) frames = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-w" ) == 0 ) width = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-h" ) == 0 ) height = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-m" ) == 0 ) illuminationMode = ParseMode( argv[i + 1] );
+		else if ( strcmp( argv[i], "-o" ) == 0 ) output = argv[i + 1];
+		else if ( strcmp( argv[i], "-f" ) == 0 ) model = argv[i + 1];
+		else if ( strcmp( argv[i], "-t" ) == 0 ) threads = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-s" ) == 0 ) simd = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-x" ) == 0 ) filter = argv[i + 1];
+		else if ( strcmp( argv[i], "-c" ) == 0 ) fastClear = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-l" ) == 0 ) wireframe = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-u" ) == 0 ) toon = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-i" ) == 0 ) instanceCount = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-e" ) == 0 ) lodLevels = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-q" ) == 0 ) pipelineDepth = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-g" ) == 0 ) pointLightCount = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-y" ) == 0 ) shadowSize = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-z" ) == 0 ) depthPass = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-a" ) == 0 ) samples = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-v" ) == 0 ) vertexFormat = argv[i + 1];
+		else if ( strcmp( argv[i], "-d" ) == 0 ) depthFormat = ParseDepthFormat( argv[i + 1] );
+		else if ( strcmp( argv[i], "-b" ) == 0 ) farPlane = ( float )atof( argv[i + 1] );
+		else if ( strcmp( argv[i], "-p" ) == 0 ) stats = argv[i + 1];
+		else if ( strcmp( argv[i], "-r" ) == 0 ) trace = argv[i + 1];
+		else
+		{
+			printf( "unknown option %s\n", argv[i] );
+			return -1;
+		}
+	}
+
+	if ( frames <= 0 || width <= 0 || height <= 0 )
+	{
+		printf( "invalid frame count or resolution\n" );
+		return -1;
+	}
+
+	OffscreenScreen* screen = new OffscreenScreen( );
+	int ret = screen->init( width, height );
+	if ( ret < 0 ) {
+		printf( "screen init failed( %d )!\n", ret );
+		return ret;
+	}
+
+	MeshCache mesh;
+	Matrix meshWorld;
+	std::vector<uint32> edges;
+	if ( model != NULL )
+	{
+		auto loadStart = std::chrono::steady_clock::now( );
+		ret = LoadObjCached( mesh, model );
+		auto loadEnd = std::chrono::steady_clock::now( );
+		if ( ret < 0 ) {
+			printf( "failed to load %s( %d )!\n", model, ret );
+			return ret;
+		}
+		printf( "loaded %s: %d vertices, %d triangles in %.3f ms\n", model, mesh.getVertexCount( ), mesh.getIndexCount( ) / 3,
+			std::chrono::duration<double, std::milli>( loadEnd - loadStart ).count( ) );
+		FitMeshToView( meshWorld, mesh.getVertices( ), mesh.getVertexCount( ) );
+		if ( wireframe ) BuildEdgeIndices( edges, mesh.getIndices( ), mesh.getIndexCount( ) );
+	}
+
+	PackedMesh packed;
+	VertexFormat format = vertexFormat != NULL && strcmp( vertexFormat, "compact" ) == 0 ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FLOAT;
+	bool usePacked = model != NULL && vertexFormat != NULL;
+	if ( usePacked )
+	{
+		PackMesh( packed, format, mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ) );
+		size_t size = ( size_t )mesh.getVertexCount( ) * sizeof( Vertex ) + ( size_t )mesh.getIndexCount( ) * sizeof( uint32 );
+		printf( "packed into %d byte vertices and %d bit indices: %.1f KB instead of %.1f KB\n", packed.layout.stride,
+			packed.indexSize * 8, packed.getSize( ) / 1024.0, size / 1024.0 );
+	}
+
+	// square grid of instances 4 units apart in the ground plane, most of them outside the view
+	SceneMesh sceneMesh;
+	Scene scene;
+	std::vector<Mesh> lods;
+	std::vector<PackedMesh> packedLods;
+	if ( model != NULL && instanceCount > 0 )
+	{
+		if ( usePacked )
+			InitSceneMesh( sceneMesh, packed );
+		else
+			InitSceneMesh( sceneMesh, mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ) );
+		if ( lodLevels > 0 )
+		{
+			auto lodStart = std::chrono::steady_clock::now( );
+			BuildMeshLods( lods, mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ),
+				std::min( lodLevels, SceneMesh::MAX_LODS - 1 ), 64 );
+			auto lodEnd = std::chrono::steady_clock::now( );
+			printf( "built %d lods in %.3f ms:", ( int )lods.size( ), std::chrono::duration<double, std::milli>( lodEnd - lodStart ).count( ) );
+			packedLods.resize( lods.size( ) );
+			for ( size_t l = 0; l < lods.size( ); l ++ )
+			{
+				if ( usePacked )
+				{
+					PackMesh( packedLods[l], format, lods[l].vertices.data( ), ( int )lods[l].vertices.size( ),
+						lods[l].indices.data( ), ( int )lods[l].indices.size( ) );
+					AddSceneMeshLod( sceneMesh, packedLods[l] );
+				}
+				else
+					AddSceneMeshLod( sceneMesh, lods[l] );
+				printf( " %d", ( int )lods[l].indices.size( ) / 3 );
+			}
+			printf( " triangles\n" );
+		}
+		int side = ( int )ceil( sqrt( ( double )instanceCount ) );
+		for ( int i = 0; i < instanceCount; i ++ )
+		{
+			Matrix offset, world;
+			MatrixSetTranslate( offset, 4.f * ( i % side - side / 2 ), 4.f * ( i / side - side / 2 ), 0.f );
+			MatrixMul( world, meshWorld, offset );
+			scene.addInstance( &sceneMesh, world );
+		}
+		scene.build( );
+	}
+
+	Transform* transform = new Transform( );
+	transform->init( width, height );
+	transform->setDepthRange( 1.f, farPlane, depthFormat == DepthFormat::FLOAT32_REVERSED );
+
+	Light light = { { 1.f, -1.f, -1.f, 0.f }, { 1.0f, 1.f, 1.f }, NULL };
+	VectorNormalize( light.direction );
+
+	// fibonacci sphere of lights just outside the model, so every one of them reaches part of it
+	std::vector<PointLight> pointLights( std::max( pointLightCount, 0 ) );
+	for ( size_t i = 0; i < pointLights.size( ); i ++ )
+	{
+		float z = 1.f - 2.f * ( i + 0.5f ) / pointLights.size( );
+		float r = sqrtf( 1.f - z * z ), phi = 2.39996323f * i;
+		float hue = ( float )i / pointLights.size( );
+		pointLights[i].position = { 2.2f * r * cosf( phi ), 2.2f * r * sinf( phi ), 2.2f * z, 1.f };
+		pointLights[i].color = { 0.5f + 0.5f * cosf( 6.2831853f * hue ), 0.5f + 0.5f * cosf( 6.2831853f * ( hue - 0.333f ) ),
+			0.5f + 0.5f * cosf( 6.2831853f * ( hue - 0.667f ) ) };
+		pointLights[i].radius = 1.2f;
+	}
+
+	int* textures[3] = { 0,0,0 };
+	Device* device = new Device( );
+	device->init( width, height, screen->getFrameBuffer( ), transform, textures, &light, illuminationMode );
+	device->setThreadCount( threads );
+	device->setSimdShading( simd != 0 );
+	device->setFastClear( fastClear != 0 );
+	device->setPipelineDepth( pipelineDepth );
+	device->setSampleCount( samples );
+	device->setDepthFormat( depthFormat );
+	device->setLights( NULL, 0, pointLights.data( ), ( int )pointLights.size( ) );
+	device->SetCamera( 5.f, 0.f, 0.f );
+
+	Texture checker;
+	if ( filter != NULL )
+	{
+		ret = CreateCheckerTexture( checker, 256, 8 );
+		if ( ret < 0 ) {
+			printf( "texture init failed( %d )!\n", ret );
+			return ret;
+		}
+	}
+
+	ShadowMap shadowMap;
+	if ( shadowSize > 0 )
+	{
+		ret = shadowMap.init( shadowSize, threads );
+		if ( ret < 0 ) {
+			printf( "shadow map init failed( %d )!\n", ret );
+			return ret;
+		}
+		shadowMap.setDepthFormat( depthFormat );
+		light.shadow = &shadowMap;
+	}
+
+#ifdef SOFTRENDER_PROFILE
+	Profiler::get( ).setTraceEnabled( trace != NULL );
+	Profiler::get( ).reset( );
+#endif
+
+	float light_theta = 0.f;
+	auto start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < frames; i ++ )
+	{
+		device->clear( );
+
+		light_theta += 0.01f;
+		if ( shadowSize > 0 )
+		{
+			// the map is read while the frame is rasterized, so a pipeline has to drain before it is redrawn
+			if ( pipelineDepth > 1 ) device->finish( );
+			light.direction = { 0.6f * cosf( light_theta ), 0.6f * sinf( light_theta ), -1.f, 0.f };
+			VectorNormalize( light.direction );
+			shadowMap.begin( light.direction, { 0.f, 0.f, -1.f, 1.f }, 3.5f );
+			if ( usePacked )
+				shadowMap.drawMesh( meshWorld, packed );
+			else if ( model != NULL )
+				shadowMap.drawMesh( meshWorld, mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ) );
+			shadowMap.end( );
+		}
+		else
+		{
+			TransformLight( transform, light, light_theta );
+		}
+
+		if ( filter != NULL || shadowSize > 0 )
+		{
+			if ( filter != NULL ) device->setTexture( &checker, ParseFilter( filter ) );
+			DrawDemoFloor( device, transform );
+			device->flush( );
+			device->setTexture( NULL, TextureFilter::TRILINEAR );
+			if ( shadowSize <= 0 ) TransformLight( transform, light, light_theta );
+		}
+
+		if ( model != NULL )
+		{
+			transform->setWorld( meshWorld );
+			transform->update( );
+			if ( instanceCount > 0 )
+				scene.draw( device, transform );
+			else if ( wireframe )
+				device->drawLines( mesh.getVertices( ), mesh.getVertexCount( ), edges.data( ), ( int )edges.size( ) );
+			else if ( toon )
+				DrawToonMesh( device, transform, &light, mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ) );
+			else
+			{
+				if ( depthPass > 0 )
+				{
+					device->setDepthOnly( true );
+					DrawModel( device, mesh, usePacked ? &packed : NULL );
+					device->setDepthOnly( false );
+				}
+				if ( depthPass < 2 )
+					DrawModel( device, mesh, usePacked ? &packed : NULL );
+			}
+		}
+		else
+		{
+			DrawDemoScene( device );
+		}
+
+		device->present( );
+		screen->update( );
+	}
+	device->finish( );
+	auto end = std::chrono::steady_clock::now( );
+
+	double seconds = std::chrono::duration<double>( end - start ).count( );
+	printf( "%d frames at %dx%d in %.3f s: %.2f frames/sec, %.3f ms/frame\n",
+		screen->getFrameCount( ), width, height, seconds, frames / seconds, seconds * 1000.0 / frames );
+
+	if ( instanceCount > 0 )
+	{
+		printf( "scene: %d of %d instances drawn, %d triangles, %d bvh nodes visited in the last frame\n",
+			scene.getVisibleCount( ), scene.getInstanceCount( ), scene.getTrianglesDrawn( ), scene.getNodesVisited( ) );
+	}
+
+	if ( output != NULL && screen->savePPM( output ) < 0 )
+	{
+		printf( "failed to write %s\n", output );
+	}
+
+#ifdef SOFTRENDER_PROFILE
+	if ( stats != NULL && Profiler::get( ).writeJson( stats ) < 0 )
+	{
+		printf( "failed to write %s\n", stats );
+	}
+	if ( trace != NULL && Profiler::get( ).writeChromeTrace( trace ) < 0 )
+	{
+		printf( "failed to write %s\n", trace );
+	}
+#else
+	if ( stats != NULL || trace != NULL )
+	{
+		printf( "profiler not compiled in, rebuild with SOFTRENDER_PROFILE\n" );
+	}
+#endif
+
+	device->close( );
+	screen->close( );
+
+	delete transform;
+	delete device;
+	delete screen;
+
+	return 0;
+}
\ No newline at end of file
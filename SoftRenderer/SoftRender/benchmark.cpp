@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "OffscreenScreen.h"
+#include "Device.h"
+#include "Transform.h"
+#include "Config.h"
+#include "Vertex.h"
+#include "Light.h"
+#include "DemoScene.h"
+#include "ObjLoader.h"
+
+#define PI 3.1415926f
+
+// reproducible benchmark: every model of a directory, seen from fixed camera orbits, at every resolution and
+// illumination mode. reports triangles/sec, shaded pixels/sec and p50 / p99 frame time per configuration,
+// and an fnv-1a checksum of all its frames so a speedup that changes the output does not go unnoticed
+// usage: SoftRenderingBenchmark [-d models] [-n frames per orbit] [-r 640x480,1280x720,1920x1080]
+//                               [-m color,diffuse,phong,blinn,deferred] [-t threads] [-s 0|1] [-g golden.txt] [-k golden.txt]
+//                               [-o results.csv]
+// -g writes the checksums, -k compares against a file written by -g and fails on any difference; checksums
+// are only comparable between builds with the same SIMD width and -s setting
+
+static const int ORBIT_COUNT = 3;
+static const float ORBIT_ELEVATION[ORBIT_COUNT] = { -15.f, 20.f, 55.f };	// degrees above the model's equator
+static const float ORBIT_DISTANCE = 5.f;
+
+static const int MODE_COUNT = 5;
+static const char* MODE_NAMES[MODE_COUNT] = { "color", "diffuse", "phong", "blinn", "deferred" };
+static const IlluminationMode MODES[MODE_COUNT] = { IlluminationMode::COLOR, IlluminationMode::DIFFUSE, IlluminationMode::PHONG,
+	IlluminationMode::BLINN, IlluminationMode::DEFERRED };
+
+struct BenchResult
+{
+	std::string			model;
+	int					width;
+	int					height;
+	int					mode;
+	int					frames;
+	double				seconds;
+	double				p50;
+	double				p99;
+	double				trianglesPerSec;
+	double				pixelsPerSec;		// pixels that passed the depth test and were shaded, overdraw included
+	unsigned long long	checksum;
+};
+
+// obj files of a directory, sorted so the run order and the golden file do not depend on the file system
+static void ListModels( std::vector<std::string>& names, const char* dir )
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA( ( std::string( dir ) + "\\*.obj" ).c_str( ), &data );
+	if ( find != INVALID_HANDLE_VALUE )
+	{
+		do names.push_back( data.cFileName ); while ( FindNextFileA( find, &data ) );
+		FindClose( find );
+	}
+#else
+	DIR* d = opendir( dir );
+	if ( d != NULL )
+	{
+		for ( dirent* e = readdir( d ); e != NULL; e = readdir( d ) )
+		{
+			size_t len = strlen( e->d_name );
+			if ( len > 4 && strcmp( e->d_name + len - 4, ".obj" ) == 0 ) names.push_back( e->d_name );
+		}
+		closedir( d );
+	}
+#endif
+	std::sort( names.begin( ), names.end( ) );
+}
+
+static int ParseResolutions( std::vector<int>& sizes, const char* list )
+{
+	sizes.clear( );
+	for ( const char* p = list; *p != '\0'; )
+	{
+		int w, h, n;
+		if ( sscanf( p, "%dx%d%n", &w, &h, &n ) != 2 || w <= 0 || h <= 0 ) return -1;
+		sizes.push_back( w );
+		sizes.push_back( h );
+		p += n;
+		if ( *p == ',' ) p ++;
+	}
+	return sizes.empty( ) ? -1 : 0;
+}
+
+static int ParseModes( std::vector<int>& modes, const char* list )
+{
+	modes.clear( );
+	std::string s( list );
+	for ( size_t start = 0; start <= s.size( ); )
+	{
+		size_t end = s.find( ',', start );
+		if ( end == std::string::npos ) end = s.size( );
+		std::string name = s.substr( start, end - start );
+		int m = 0;
+		while ( m < MODE_COUNT && name != MODE_NAMES[m] ) m ++;
+		if ( m == MODE_COUNT ) return -1;
+		modes.push_back( m );
+		start = end + 1;
+	}
+	return 0;
+}
+
+static inline unsigned long long Fnv1a( unsigned long long hash, const uint32* pixels, int count )
+{
+	for ( int i = 0; i < count; i ++ )
+	{
+		uint32 c = pixels[i];
+		for ( int k = 0; k < 3; k ++ )
+		{
+			hash ^= ( c >> ( 8 * k ) ) & 0xff;
+			hash *= 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+// nearest rank percentile of sorted frame times
+static inline double Percentile( const std::vector<double>& sorted, double p )
+{
+	int rank = ( int )ceil( p * sorted.size( ) ) - 1;
+	return sorted[std::min( std::max( rank, 0 ), ( int )sorted.size( ) - 1 )];
+}
+
+static void PlaceCamera( Device* device, int orbit, int frame, int framesPerOrbit )
+{
+	float theta = 2.f * PI * frame / framesPerOrbit;
+	float phi = ORBIT_ELEVATION[orbit] * PI / 180.f;
+	device->SetCamera( ORBIT_DISTANCE * cosf( phi ) * cosf( theta ), ORBIT_DISTANCE * cosf( phi ) * sinf( theta ),
+		ORBIT_DISTANCE * sinf( phi ) );
+}
+
+static void DrawModel( Device* device, Transform* transform, const MeshCache& mesh, const Matrix& world )
+{
+	transform->setWorld( world );
+	transform->update( );
+	device->drawMesh( mesh.getVertices( ), mesh.getVertexCount( ), mesh.getIndices( ), mesh.getIndexCount( ) );
+	device->present( );
+}
+
+static int WriteGolden( const std::vector<BenchResult>& results, const char* path )
+{
+	FILE* fp = fopen( path, "w" );
+	if ( fp == NULL ) return -1;
+	for ( size_t i = 0; i < results.size( ); i ++ )
+	{
+		const BenchResult& r = results[i];
+		fprintf( fp, "%s %dx%d %s %016llx\n", r.model.c_str( ), r.width, r.height, MODE_NAMES[r.mode], r.checksum );
+	}
+	fclose( fp );
+	return 0;
+}
+
+// returns the number of configurations whose checksum differs from the file or is missing in it
+static int CheckGolden( const std::vector<BenchResult>& results, const char* path )
+{
+	FILE* fp = fopen( path, "r" );
+	if ( fp == NULL ) return -1;
+
+	std::vector<std::string> keys;
+	std::vector<unsigned long long> sums;
+	char model[256], size[64], mode[64];
+	unsigned long long sum;
+	while ( fscanf( fp, "%255s %63s %63s %llx", model, size, mode, &sum ) == 4 )
+	{
+		keys.push_back( std::string( model ) + " " + size + " " + mode );
+		sums.push_back( sum );
+	}
+	fclose( fp );
+
+	int failed = 0;
+	for ( size_t i = 0; i < results.size( ); i ++ )
+	{
+		const BenchResult& r = results[i];
+		char key[512];
+		snprintf( key, sizeof( key ), "%s %dx%d %s", r.model.c_str( ), r.width, r.height, MODE_NAMES[r.mode] );
+
+		size_t k = std::find( keys.begin( ), keys.end( ), key ) - keys.begin( );
+		if ( k == keys.size( ) )
+		{
+			printf( "golden: %s missing\n", key );
+			failed ++;
+		}
+		else if ( sums[k] != r.checksum )
+		{
+			printf( "golden: %s changed, %016llx expected, %016llx rendered\n", key, sums[k], r.checksum );
+			failed ++;
+		}
+	}
+	return failed;
+}
+
+static int WriteCsv( const std::vector<BenchResult>& results, const char* path )
+{
+	FILE* fp = fopen( path, "w" );
+	if ( fp == NULL ) return -1;
+	fprintf( fp, "model,width,height,mode,frames,seconds,p50_ms,p99_ms,triangles_per_sec,shaded_pixels_per_sec,checksum\n" );
+	for ( size_t i = 0; i < results.size( ); i ++ )
+	{
+		const BenchResult& r = results[i];
+		fprintf( fp, "%s,%d,%d,%s,%d,%.6f,%.4f,%.4f,%.0f,%.0f,%016llx\n", r.model.c_str( ), r.width, r.height, MODE_NAMES[r.mode],
+			r.frames, r.seconds, r.p50, r.p99, r.trianglesPerSec, r.pixelsPerSec, r.checksum );
+	}
+	fclose( fp );
+	return 0;
+}
+
+int main( int argc, char* argv[] )
+{
+	const char* dir = "models";
+	int framesPerOrbit = 24;
+	const char* resolutionList = "640x480,1280x720,1920x1080";
+	const char* modeList = "color,diffuse,phong,blinn";
+	int threads = 0;
+	int simd = 1;
+	const char* golden = NULL;
+	const char* check = NULL;
+	const char* csv = NULL;
+
+	for ( int i = 1; i + 1 < argc; i += 2 )
+	{
+		if ( strcmp( argv[i], "-d" ) == 0 ) dir = argv[i + 1];
+		else if ( strcmp( argv[i], "-n" ) == 0 ) framesPerOrbit = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-r" ) == 0 ) resolutionList = argv[i + 1];
+		else if ( strcmp( argv[i], "-m" ) == 0 ) modeList = argv[i + 1];
+		else if ( strcmp( argv[i], "-t" ) == 0 ) threads = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-s" ) == 0 ) simd = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-g" ) == 0 ) golden = argv[i + 1];
+		else if ( strcmp( argv[i], "-k" ) == 0 ) check = argv[i + 1];
+		else if ( strcmp( argv[i], "-o" ) == 0 ) csv = argv[i + 1];
+		else
+		{
+			printf( "unknown option %s\n", argv[i] );
+			return -1;
+		}
+	}
+
+	std::vector<int> resolutions, modes;
+	if ( framesPerOrbit <= 0 || ParseResolutions( resolutions, resolutionList ) < 0 || ParseModes( modes, modeList ) < 0 )
+	{
+		printf( "invalid frame count, resolution or mode list\n" );
+		return -1;
+	}
+
+	std::vector<std::string> names;
+	ListModels( names, dir );
+	if ( names.empty( ) )
+	{
+		printf( "no obj files in %s\n", dir );
+		return -1;
+	}
+
+	// every mesh is loaded once up front so parsing never shows up in the frame times
+	std::vector<MeshCache*> meshes;
+	std::vector<Matrix> worlds;
+	for ( size_t i = 0; i < names.size( ); i ++ )
+	{
+		MeshCache* mesh = new MeshCache( );
+		std::string path = std::string( dir ) + "/" + names[i];
+		int ret = LoadObjCached( *mesh, path.c_str( ) );
+		if ( ret < 0 || mesh->getIndexCount( ) == 0 )
+		{
+			printf( "skipping %s( %d )\n", path.c_str( ), ret );
+			delete mesh;
+			names.erase( names.begin( ) + i );
+			i --;
+			continue;
+		}
+		Matrix world;
+		FitMeshToView( world, mesh->getVertices( ), mesh->getVertexCount( ) );
+		meshes.push_back( mesh );
+		worlds.push_back( world );
+	}
+
+	Light light = { { 1.f, -1.f, -1.f, 0.f }, { 1.0f, 1.f, 1.f }, NULL };
+	VectorNormalize( light.direction );
+	int* textures[3] = { 0,0,0 };
+
+	printf( "%-12s %10s %-8s %10s %10s %14s %14s %18s\n", "model", "size", "mode", "p50 ms", "p99 ms", "Mtris/sec", "Mshaded px/s", "checksum" );
+
+	std::vector<BenchResult> results;
+	for ( size_t r = 0; r < resolutions.size( ); r += 2 )
+	{
+		int width = resolutions[r], height = resolutions[r + 1];
+
+		OffscreenScreen* screen = new OffscreenScreen( );
+		int ret = screen->init( width, height );
+		if ( ret < 0 ) {
+			printf( "screen init failed( %d )!\n", ret );
+			return ret;
+		}
+
+		Transform* transform = new Transform( );
+		transform->init( width, height );
+
+		Device* device = new Device( );
+		device->init( width, height, screen->getFrameBuffer( ), transform, textures, &light, IlluminationMode::COLOR );
+		device->setThreadCount( threads );
+		device->setSimdShading( simd != 0 );
+
+		for ( size_t m = 0; m < meshes.size( ); m ++ )
+		{
+			for ( size_t k = 0; k < modes.size( ); k ++ )
+			{
+				device->setIlluminationMode( MODES[modes[k]] );
+
+				// one untimed frame warms the caches and lets the device grow its vertex cache
+				PlaceCamera( device, 0, 0, framesPerOrbit );
+				device->clear( );
+				DrawModel( device, transform, *meshes[m], worlds[m] );
+
+				std::vector<double> times;
+				unsigned long long checksum = 0xcbf29ce484222325ull;
+				long long pixels = device->getPixelsWritten( );
+				for ( int orbit = 0; orbit < ORBIT_COUNT; orbit ++ )
+				{
+					for ( int f = 0; f < framesPerOrbit; f ++ )
+					{
+						PlaceCamera( device, orbit, f, framesPerOrbit );
+						auto start = std::chrono::steady_clock::now( );
+						device->clear( );
+						DrawModel( device, transform, *meshes[m], worlds[m] );
+						auto end = std::chrono::steady_clock::now( );
+						times.push_back( std::chrono::duration<double, std::milli>( end - start ).count( ) );
+						checksum = Fnv1a( checksum, screen->getFrameBuffer( ), width * height );
+					}
+				}
+
+				BenchResult result;
+				result.model = names[m];
+				result.width = width;
+				result.height = height;
+				result.mode = modes[k];
+				result.frames = ( int )times.size( );
+				result.seconds = 0.0;
+				for ( size_t i = 0; i < times.size( ); i ++ ) result.seconds += times[i] * 1e-3;
+				std::sort( times.begin( ), times.end( ) );
+				result.p50 = Percentile( times, 0.50 );
+				result.p99 = Percentile( times, 0.99 );
+				result.trianglesPerSec = ( double )( meshes[m]->getIndexCount( ) / 3 ) * result.frames / result.seconds;
+				result.pixelsPerSec = ( double )( device->getPixelsWritten( ) - pixels ) / result.seconds;
+				result.checksum = checksum;
+				results.push_back( result );
+
+				printf( "%-12s %4dx%-5d %-8s %10.3f %10.3f %14.3f %14.3f   %016llx\n", result.model.c_str( ), width, height,
+					MODE_NAMES[result.mode], result.p50, result.p99, result.trianglesPerSec * 1e-6, result.pixelsPerSec * 1e-6,
+					result.checksum );
+			}
+		}
+
+		device->close( );
+		screen->close( );
+
+		delete transform;
+		delete device;
+		delete screen;
+	}
+
+	for ( size_t m = 0; m < meshes.size( ); m ++ ) delete meshes[m];
+
+	if ( csv != NULL && WriteCsv( results, csv ) < 0 )
+	{
+		printf( "failed to write %s\n", csv );
+	}
+	if ( golden != NULL && WriteGolden( results, golden ) < 0 )
+	{
+		printf( "failed to write %s\n", golden );
+	}
+	if ( check != NULL )
+	{
+		int failed = CheckGolden( results, check );
+		if ( failed < 0 )
+		{
+			printf( "failed to read %s\n", check );
+			return -1;
+		}
+		printf( "golden: %d of %d configurations match\n", ( int )results.size( ) - failed, ( int )results.size( ) );
+		if ( failed > 0 ) return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file
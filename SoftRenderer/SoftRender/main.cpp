@@ -14,6 +14,7 @@
 #include "Config.h"
 #include "Vertex.h"
 #include "Light.h"
+#include "DemoScene.h"
 #include <fcntl.h>
 #include <io.h>
 #include <tchar.h>
@@ -34,17 +35,6 @@ void InitConsoleWindow( )
 	}
 }
 
-void TransformLight( Light& light, float theta )
-{
-	Matrix m;
-	MatrixSetRotate( m, 0.f, 0.0f, 1.f, theta );
-	transform->setWorld( m );
-	transform->update( );
-
-	transform->applyWV( light.direction, { - 0.3f, 1.f, - 0.3f, 0.f } );
-	VectorNormalize( light.direction );
-}
-
 #define VK_J 0x4A
 #define VK_K 0x4B
 
@@ -66,16 +56,19 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, i
 	transform->init( WINDOW_WIDTH, WINDOW_HEIGHT );
 
 	// ùԴ
-	Light light = { { 1.f, -1.f, -1.f, 0.f }, { 1.0f, 1.f, 1.f } };
+	Light light = { { 1.f, -1.f, -1.f, 0.f }, { 1.0f, 1.f, 1.f }, NULL };
 	VectorNormalize( light.direction );
 
 	// 豸
-	uint32* wfb = ( uint32* )( screen->getFrameBuffer( ) );
+	uint32* wfb = screen->getFrameBuffer( );
 	IlluminationMode illuminationMode = IlluminationMode::BLINN;
 	device = new Device( );
 	device->init( WINDOW_WIDTH, WINDOW_HEIGHT, wfb, transform, textures, &light, illuminationMode );
 	device->SetCamera( 5.f, 0.f, 0.f );
 
+	// ˫ˮ: դ̻߳һ֡ͬʱ, ̴߳һ֡ļβʾ
+	device->setPipelineDepth( 2 );
+
 	float light_theta = 0.f;
 	while ( !screen->isExit( ) )
 	{
@@ -83,60 +76,11 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, i
 		screen->dispatch( );
 
 		light_theta += 0.01f;
-		TransformLight( light, light_theta );
-
-		Vertex v1 = { { 300.f, 400.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawPoint2d( v1 );
-		Vertex v2 = { { 301.f, 400.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawPoint2d( v2 );
-		Vertex v3 = { { 299.f, 400.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawPoint2d( v3 );
-		Vertex v4 = { { 300.f, 401.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawPoint2d( v4 );
-		Vertex v5 = { { 300.f, 399.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawPoint2d( v5 );
-
-		Vertex v6 = { { 0.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v7 = { { 0.f, -1.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawLine3d( v6, v7 );
-
-		Vertex v8 = { { 0.f, -1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v9 = { { 0.f, 1.f, -1.f, 1.f }, { 1.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawLine3d( v8, v9 );
-
-		Vertex v10 = { { 0.f, 1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v11 = { { 0.f, -1.f, 0.f, 1.f }, { 1.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawLine3d( v10, v11 );
-
-		Vertex v12 = { { 0.f, 0.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v13 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawLine3d( v12, v13 );
-
-		Vertex v14 = { { 0.f, -1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v15 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v16 = { { 0.f, 1.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawTriangle3d( v14, v15, v16 );
-
-		Vertex v17 = { { 0.f, -1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v18 = { { 0.f, 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v19 = { { 0.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawTriangle3d( v17, v18, v19 );
-
-		Vertex v20 = { { 0.f, -1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v21 = { { 0.f, -1.f, -2.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v22 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawTriangle3d( v20, v21, v22 );
-
-		Vertex v23 = { { 0.f, 1.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v24 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v25 = { { 0.f, 1.f, -2.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawTriangle3d( v23, v24, v25 );
-
-		Vertex v26 = { { 0.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v27 = { { 0.f, -1.f, -2.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		Vertex v28 = { { 0.f, 1.f, -2.f, 1.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f }, { 1.0f, 0.f, 0.f, 0.f } };
-		device->drawTriangle3d( v26, v27, v28 );
+		TransformLight( transform, light, light_theta );
+
+		DrawDemoScene( device );
 
+		device->present( );
 		screen->dispatch( );
 		screen->update( );
 		Sleep( 1 );
@@ -1,4 +1,5 @@
 #include "math.h"
+#include "SimdFloat.h"
 
 void VectorAdd( Vector& v, const Vector& x, const Vector& y )
 {
@@ -92,11 +93,23 @@ void MatrixSub( Matrix& m, const Matrix& a, const Matrix& b )
 
 void MatrixMul( Matrix& m, const Matrix& a, const Matrix& b )
 {
+#if defined( SIMD_SSE ) || defined( SIMD_AVX )
+	// row j of m is the rows of b weighted by row j of a, same summation order as the scalar loop
+	__m128 b0 = _mm_loadu_ps( b.m[0] ), b1 = _mm_loadu_ps( b.m[1] ), b2 = _mm_loadu_ps( b.m[2] ), b3 = _mm_loadu_ps( b.m[3] );
+	for ( int j = 0; j < 4; j ++ ) {
+		__m128 r = _mm_mul_ps( _mm_set1_ps( a.m[j][0] ), b0 );
+		r = _mm_add_ps( r, _mm_mul_ps( _mm_set1_ps( a.m[j][1] ), b1 ) );
+		r = _mm_add_ps( r, _mm_mul_ps( _mm_set1_ps( a.m[j][2] ), b2 ) );
+		r = _mm_add_ps( r, _mm_mul_ps( _mm_set1_ps( a.m[j][3] ), b3 ) );
+		_mm_storeu_ps( m.m[j], r );
+	}
+#else
 	for ( int i = 0; i < 4; i ++ ) {
 		for ( int j = 0; j < 4; j ++ ) {
 			m.m[j][i] = ( a.m[j][0] * b.m[0][i] ) + ( a.m[j][1] * b.m[1][i] ) + ( a.m[j][2] * b.m[2][i] ) + ( a.m[j][3] * b.m[3][i] );
 		}
 	}
+#endif
 }
 
 // matrix m = a * f
@@ -187,6 +200,42 @@ void MatrixSetLookAt( Matrix& m, const Vector& eye, const Vector& at, const Vect
 	m.m[3][3] = 1.0f;
 }
 
+bool MatrixInverse( Matrix& m, const Matrix& a )
+{
+	double t[4][8];
+	for ( int i = 0; i < 4; i ++ ) {
+		for ( int j = 0; j < 4; j ++ ) {
+			t[i][j] = a.m[i][j];
+			t[i][j + 4] = i == j ? 1.0 : 0.0;
+		}
+	}
+
+	for ( int c = 0; c < 4; c ++ ) {
+		// partial pivoting on the largest remaining entry of the column
+		int pivot = c;
+		for ( int r = c + 1; r < 4; r ++ ) {
+			if ( fabs( t[r][c] ) > fabs( t[pivot][c] ) ) pivot = r;
+		}
+		if ( t[pivot][c] == 0.0 ) return false;
+		for ( int j = 0; j < 8; j ++ ) std::swap( t[c][j], t[pivot][j] );
+
+		double inv = 1.0 / t[c][c];
+		for ( int j = 0; j < 8; j ++ ) t[c][j] *= inv;
+		for ( int r = 0; r < 4; r ++ ) {
+			if ( r == c || t[r][c] == 0.0 ) continue;
+			double f = t[r][c];
+			for ( int j = 0; j < 8; j ++ ) t[r][j] -= f * t[c][j];
+		}
+	}
+
+	for ( int i = 0; i < 4; i ++ ) {
+		for ( int j = 0; j < 4; j ++ ) {
+			m.m[i][j] = ( float )t[i][j + 4];
+		}
+	}
+	return true;
+}
+
 void MatrixSetPerspective( Matrix& m, float fovy, float aspect, float zn, float zf )
 {
 	float fax = 1.0f / ( float )tan( fovy * 0.5f );
@@ -196,4 +245,72 @@ void MatrixSetPerspective( Matrix& m, float fovy, float aspect, float zn, float
 	m.m[2][2] = zf / ( zf - zn );
 	m.m[3][2] = - zn * zf / ( zf - zn );
 	m.m[2][3] = 1;
+}
+
+void MatrixSetOrthographic( Matrix& m, float w, float h, float zn, float zf )
+{
+	MatrixSetZero( m );
+	m.m[0][0] = 2.f / w;
+	m.m[1][1] = 2.f / h;
+	m.m[2][2] = 1.f / ( zf - zn );
+	m.m[3][2] = - zn / ( zf - zn );
+	m.m[3][3] = 1.f;
+}
+
+void VectorSoAGather( VectorSoA& v, const Vector* x, int stride, int count )
+{
+	const char* p = ( const char* )x;
+	for ( int i = 0; i < count; i ++, p += stride )
+	{
+		const Vector& a = *( const Vector* )p;
+		v.x[i] = a.x;
+		v.y[i] = a.y;
+		v.z[i] = a.z;
+		v.w[i] = a.w;
+	}
+}
+
+// matrix v = x * m for count points, SIMD_WIDTH at a time with a scalar tail
+void MatrixApplySoA( VectorSoA& v, const VectorSoA& x, int count, const Matrix& m )
+{
+	int i = 0;
+	for ( ; i + SIMD_WIDTH <= count; i += SIMD_WIDTH )
+	{
+		vfloat X = vload( x.x + i ), Y = vload( x.y + i ), Z = vload( x.z + i ), W = vload( x.w + i );
+		vstore( v.x + i, X * vset1( m.m[0][0] ) + Y * vset1( m.m[1][0] ) + Z * vset1( m.m[2][0] ) + W * vset1( m.m[3][0] ) );
+		vstore( v.y + i, X * vset1( m.m[0][1] ) + Y * vset1( m.m[1][1] ) + Z * vset1( m.m[2][1] ) + W * vset1( m.m[3][1] ) );
+		vstore( v.z + i, X * vset1( m.m[0][2] ) + Y * vset1( m.m[1][2] ) + Z * vset1( m.m[2][2] ) + W * vset1( m.m[3][2] ) );
+		vstore( v.w + i, X * vset1( m.m[0][3] ) + Y * vset1( m.m[1][3] ) + Z * vset1( m.m[2][3] ) + W * vset1( m.m[3][3] ) );
+	}
+	for ( ; i < count; i ++ )
+	{
+		Vector r;
+		MatrixApply( r, { x.x[i], x.y[i], x.z[i], x.w[i] }, m );
+		v.x[i] = r.x;
+		v.y[i] = r.y;
+		v.z[i] = r.z;
+		v.w[i] = r.w;
+	}
+}
+
+// directions ignore the translation row, the result has w = 0
+void MatrixApplyNormalSoA( VectorSoA& v, const VectorSoA& x, int count, const Matrix& m )
+{
+	int i = 0;
+	for ( ; i + SIMD_WIDTH <= count; i += SIMD_WIDTH )
+	{
+		vfloat X = vload( x.x + i ), Y = vload( x.y + i ), Z = vload( x.z + i );
+		vstore( v.x + i, X * vset1( m.m[0][0] ) + Y * vset1( m.m[1][0] ) + Z * vset1( m.m[2][0] ) );
+		vstore( v.y + i, X * vset1( m.m[0][1] ) + Y * vset1( m.m[1][1] ) + Z * vset1( m.m[2][1] ) );
+		vstore( v.z + i, X * vset1( m.m[0][2] ) + Y * vset1( m.m[1][2] ) + Z * vset1( m.m[2][2] ) );
+		vstore( v.w + i, vset1( 0.f ) );
+	}
+	for ( ; i < count; i ++ )
+	{
+		float X = x.x[i], Y = x.y[i], Z = x.z[i];
+		v.x[i] = X * m.m[0][0] + Y * m.m[1][0] + Z * m.m[2][0];
+		v.y[i] = X * m.m[0][1] + Y * m.m[1][1] + Z * m.m[2][1];
+		v.z[i] = X * m.m[0][2] + Y * m.m[1][2] + Z * m.m[2][2];
+		v.w[i] = 0.f;
+	}
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #endif
 
 #include <algorithm>
+#include <math.h>
 
 struct Vector
 {
@@ -28,6 +29,15 @@ struct Matrix
 	float m[4][4];
 };
 
+// structure of arrays view of a vector stream, one array per component, for the batch kernels below
+struct VectorSoA
+{
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+};
+
 void	VectorAdd( Vector& v, const Vector& x, const Vector& y );
 void	VectorSub( Vector& v, const Vector& x, const Vector& y );
 void	VectorMul( Vector& v, const Vector& x, float f );
@@ -47,11 +57,23 @@ void	MatrixSub( Matrix& m, const Matrix& a, const Matrix& b );
 void	MatrixMul( Matrix& m, const Matrix& a, const Matrix& b );
 void	MatrixScale( Matrix& m, const Matrix& a, const float f );
 void	MatrixApply( Vector& v, const Vector& x, const Matrix& m );
+// general inverse by gauss-jordan elimination, false and m untouched when a is singular
+bool	MatrixInverse( Matrix& m, const Matrix& a );
 void	MatrixSetTranslate( Matrix& m, float x, float y, float z );
 void	MatrixSetScale( Matrix& m, float x, float y, float z );
 void	MatrixSetRotate( Matrix& m, float x, float y, float z, float theta );
 void	MatrixSetLookAt( Matrix& m, const Vector& eye, const Vector& at, const Vector& up );
+// view depth zn to 0 and fn to 1 after the divide by w; the far plane passed as zn and the near one as fn give
+// the reversed mapping, near to 1 and far to 0
 void	MatrixSetPerspective( Matrix& m, float fovy, float aspect, float zn, float fn );
+// view space box w x h around the z axis, z from zn to zf mapped to [0, 1] like MatrixSetPerspective
+void	MatrixSetOrthographic( Matrix& m, float w, float h, float zn, float zf );
+
+// batch kernels, SIMD_WIDTH vectors per step: gather count vectors placed stride bytes apart into SoA form,
+// transform points ( x * m ) and directions ( x * upper 3x3 of m, w = 0 )
+void	VectorSoAGather( VectorSoA& v, const Vector* x, int stride, int count );
+void	MatrixApplySoA( VectorSoA& v, const VectorSoA& x, int count, const Matrix& m );
+void	MatrixApplyNormalSoA( VectorSoA& v, const VectorSoA& x, int count, const Matrix& m );
 
 inline void getMinAABB2d( Vector& min, const Vector& a, const Vector& b, const Vector& c )
 {